@@ -0,0 +1,32 @@
+#include "aot.h"
+
+#include "chip8.h"
+#include "threaded.h"
+
+void set_chip8_aot(chip8_t* cpu, const aot_t* aot) {
+    // Only the lines that already differ from the ROM need comparing before their code runs,
+    // writes mark the others as they happen, lines past the ROM hold no compiled code
+    cpu->aot = aot;
+    memset(cpu->written_lines, 0xFF, sizeof(cpu->written_lines));
+    if (!aot) {
+        return;
+    }
+
+    uint32_t end = PC_START_ADDR + aot->size < MEMORY_SIZE ? PC_START_ADDR + aot->size : MEMORY_SIZE;
+    for (uint32_t line = PC_START_ADDR / WRITTEN_LINE_SIZE; line * WRITTEN_LINE_SIZE < end; line++) {
+        uint32_t start = line * WRITTEN_LINE_SIZE < PC_START_ADDR ? PC_START_ADDR : line * WRITTEN_LINE_SIZE;
+        uint32_t stop = (line + 1) * WRITTEN_LINE_SIZE < end ? (line + 1) * WRITTEN_LINE_SIZE : end;
+        if (memcmp(&cpu->memory[start], &aot->rom[start - PC_START_ADDR], stop - start) == 0) {
+            cpu->written_lines[line / 64] &= ~(1ull << (line % 64));
+        }
+    }
+}
+
+// Returns the instructions run, less than `budget` if one started waiting
+int run_aot(chip8_t* cpu, int budget) {
+    // Without an engine for this profile, the threaded backend is the closest
+    if (!cpu->aot || cpu->aot->quirks != cpu->quirks) {
+        return run_threaded(cpu, budget);
+    }
+    return cpu->aot->run(cpu, budget);
+}
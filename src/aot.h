@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string.h>
+
+#include "chip8_t.h"
+
+typedef int (*RunFuncPtr)(chip8_t* cpu, int budget);
+
+// ROM-specific engine, a translation unit generated by `chip8-aot` and linked in with the core
+struct aot {
+    const uint8_t* rom;  // Bytes compiled, loaded at `PC_START_ADDR`, followed by the word after the ROM
+    uint32_t size;       // Bytes of `rom`
+    uint8_t quirks;      // `quirks_t` the ROM was compiled for, other profiles run in the threaded backend
+    RunFuncPtr run;      // Runs the compiled blocks and interprets the rest, returns the instructions run
+};
+
+void set_chip8_aot(chip8_t* cpu, const aot_t* aot);
+int run_aot(chip8_t* cpu, int budget);
+
+// Whether the code compiled from `address` to `address + size` is still in memory, lines that were never
+// written since the engine was set are, the others are compared with the ROM
+static inline bool is_aot_code_intact(const chip8_t* cpu, const uint8_t* rom, uint16_t address, int size) {
+    for (int line = address / WRITTEN_LINE_SIZE; line <= (address + size - 1) / WRITTEN_LINE_SIZE; line++) {
+        if ((cpu->written_lines[line / 64] >> (line % 64)) & 1) {
+            return memcmp(&cpu->memory[address], &rom[address - PC_START_ADDR], size) == 0;
+        }
+    }
+    return true;
+}
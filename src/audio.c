@@ -2,30 +2,116 @@
 
 #include <SDL3/SDL.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <string.h>
 
 #define BUFFER_SIZE 1024
 #define SAMPLE_RATE 48000
-#define AMPLITUDE 0.15  // Volume level (0.0 to 1.0)
-#define FREQUENCY 500   // B4 note frequency
-
-#define PHASE_INCREMENT (2 * M_PI * FREQUENCY / SAMPLE_RATE)  // Phase increment for sine wave generation
+#define AMPLITUDE 0.15f  // Volume level (0.0 to 1.0)
+#define FREQUENCY 500    // B4 note frequency
+
+#define WAVETABLE_SIZE 256                         // Samples of one period of the tone, indexed by the top phase bits
+#define RAMP_SAMPLES 96                            // 2 ms attack and release, gating at full volume would click
+#define SAMPLES_PER_TICK (SAMPLE_RATE / 60)        // Samples per sound timer tick
+#define PATTERN_BITS (AUDIO_PATTERN_SIZE * 8)      // One-bit samples of the XO-CHIP pattern
+#define SOUND_WORDS (3 + AUDIO_PATTERN_SIZE / 4)  // Words of a packed `sound_t`
+
+// Phase step of the tone per sample, a full turn of the 32-bit phase is one period
+#define TONE_INCREMENT ((uint32_t)((uint64_t)FREQUENCY * WAVETABLE_SIZE * (1ull << 24) / SAMPLE_RATE))
+
+// What the callback plays, published by the emulation thread once per frame
+typedef struct {
+    uint32_t generation;         // Bumped every frame the sound timer runs, which restarts the countdown from it
+    uint32_t samples;            // Samples to play from the start of `generation`
+    uint32_t pattern_increment;  // Phase step of the pattern per sample, 0 for the plain tone
+    uint8_t pattern[AUDIO_PATTERN_SIZE];
+} sound_t;
 
 static SDL_AudioDeviceID audio_device = 0;
 static SDL_AudioStream* audio_stream = NULL;
 
-static float current_phase = 0;
+static float wavetable[WAVETABLE_SIZE];
+
+// Seqlock between the emulation thread and the audio callback, the writer never waits and the reader
+// only retries if it raced with a write, `sequence` is odd while a write is in progress
+static atomic_uint sequence;
+static atomic_uint shared[SOUND_WORDS];
+
+// Owned by the emulation thread
+static sound_t published;
+static uint8_t last_sound_timer = 0;
+
+// Owned by the audio callback
+static uint32_t seen_generation = 0;
+static uint32_t remaining = 0;  // Samples left before the release
+static uint32_t tone_phase = 0;
+static uint32_t pattern_phase = 0;
+static float gain = 0;
+
+static void publish_sound(const sound_t* sound) {
+    uint32_t words[SOUND_WORDS] = {sound->generation, sound->samples, sound->pattern_increment};
+    memcpy(&words[3], sound->pattern, AUDIO_PATTERN_SIZE);
+
+    unsigned start = atomic_load_explicit(&sequence, memory_order_relaxed);
+    atomic_store_explicit(&sequence, start + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (int i = 0; i < SOUND_WORDS; i++) {
+        atomic_store_explicit(&shared[i], words[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&sequence, start + 2, memory_order_release);
+}
+
+static void read_sound(sound_t* sound) {
+    uint32_t words[SOUND_WORDS];
+    unsigned start;
+    do {
+        start = atomic_load_explicit(&sequence, memory_order_acquire);
+        for (int i = 0; i < SOUND_WORDS; i++) {
+            words[i] = atomic_load_explicit(&shared[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+    } while ((start & 1) || start != atomic_load_explicit(&sequence, memory_order_relaxed));
+
+    sound->generation = words[0];
+    sound->samples = words[1];
+    sound->pattern_increment = words[2];
+    memcpy(sound->pattern, &words[3], AUDIO_PATTERN_SIZE);
+}
+
 static void audio_callback(void* userdata, SDL_AudioStream* stream, int additional_amount, int total_amount) {
     int sample_amount = total_amount / sizeof(float);  // `total_amount` is the total number of bytes, which needs to be converted to number of float samples
 
-    // Generate sine wave samples
+    sound_t sound;
+    read_sound(&sound);
+    if (sound.generation != seen_generation) {
+        seen_generation = sound.generation;
+        remaining = sound.samples;
+    }
+
     static float buffer[BUFFER_SIZE];  // Static buffer to avoid dynamic allocation
     while (sample_amount > 0) {
         int chunk_size = (sample_amount < BUFFER_SIZE) ? sample_amount : BUFFER_SIZE;
 
         for (int i = 0; i < chunk_size; i++) {
-            buffer[i] = sinf(current_phase) * AMPLITUDE;
-            current_phase += PHASE_INCREMENT;
-            if (current_phase >= 2 * M_PI) current_phase -= 2 * M_PI;
+            // Ramp towards the gate, which closes on the exact sample the timer runs out
+            float target = remaining ? AMPLITUDE : 0;
+            if (remaining) remaining--;
+            if (gain < target) {
+                gain = fminf(gain + AMPLITUDE / RAMP_SAMPLES, target);
+            } else if (gain > target) {
+                gain = fmaxf(gain - AMPLITUDE / RAMP_SAMPLES, target);
+            }
+
+            float value;
+            if (sound.pattern_increment) {
+                uint32_t bit = pattern_phase / (UINT32_MAX / PATTERN_BITS + 1);
+                value = (sound.pattern[bit / 8] >> (7 - bit % 8)) & 1 ? 1.0f : -1.0f;
+                pattern_phase += sound.pattern_increment;
+            } else {
+                value = wavetable[tone_phase >> 24];
+                tone_phase += TONE_INCREMENT;
+            }
+            buffer[i] = value * gain;
         }
 
         SDL_PutAudioStreamData(stream, buffer, chunk_size * sizeof(float));
@@ -39,6 +125,11 @@ bool audio_init(void) {
         return false;
     }
 
+    // One period of the tone, the callback only looks samples up
+    for (int i = 0; i < WAVETABLE_SIZE; i++) {
+        wavetable[i] = sinf(2 * M_PI * i / WAVETABLE_SIZE);
+    }
+
     // Set audio configuration
     SDL_AudioSpec config = {
         .freq = SAMPLE_RATE,
@@ -46,6 +137,9 @@ bool audio_init(void) {
         .channels = 1,
     };
 
+    // Small device buffers, the gate can only react once per callback
+    SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, "256");
+
     // Open audio device
     audio_device = SDL_OpenAudioDevice(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &config);
     if (!audio_device) {
@@ -54,9 +148,6 @@ bool audio_init(void) {
         return false;
     }
 
-    // Immediately pause the audio device to prevent it from playing noise
-    SDL_PauseAudioDevice(audio_device);
-
     audio_stream = SDL_CreateAudioStream(&config, &config);
     if (!audio_stream) {
         SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to create audio stream: %s", SDL_GetError());
@@ -64,7 +155,7 @@ bool audio_init(void) {
         return false;
     }
 
-    // Set audio callback, which generates sound when requested
+    // Set audio callback, which generates silence or sound, the device never stops
     if (!SDL_SetAudioStreamGetCallback(audio_stream, audio_callback, NULL)) {
         SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to set audio callback: %s", SDL_GetError());
         audio_cleanup();
@@ -77,14 +168,40 @@ bool audio_init(void) {
         return false;
     }
 
+    if (!SDL_ResumeAudioDevice(audio_device)) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to start audio device: %s", SDL_GetError());
+        audio_cleanup();
+        return false;
+    }
+
     return true;
 }
 
-bool audio_update(chip8_t* cpu) {
-    if (cpu->sound_timer > 0) {
-        return SDL_ResumeAudioDevice(audio_device);
-    } else {
-        return SDL_PauseAudioDevice(audio_device);
+// Called by the emulation thread at the end of every frame, never blocks
+void audio_update(const chip8_t* cpu) {
+    sound_t sound = published;
+
+    // Restart the countdown from the timer every frame it runs, a ROM that keeps setting the same value keeps
+    // the buzzer on, the last tick is left to the countdown, which closes the gate on its exact sample,
+    // a timer set to 0 by the ROM or a rewind cuts the sound
+    bool is_run_out = !cpu->sound_timer && last_sound_timer == 1;
+    if ((cpu->sound_timer || last_sound_timer) && !is_run_out) {
+        sound.generation++;
+        sound.samples = cpu->sound_timer * SAMPLES_PER_TICK;
+    }
+    last_sound_timer = cpu->sound_timer;
+
+    // XO-CHIP plays the pattern at 4000 * 2 ^ ((pitch - 64) / 48) samples per second
+    sound.pattern_increment = 0;
+    if (cpu->is_audio_pattern) {
+        double rate = 4000 * pow(2, (cpu->audio_pitch - AUDIO_DEFAULT_PITCH) / 48.0);
+        sound.pattern_increment = rate / SAMPLE_RATE * (UINT32_MAX / PATTERN_BITS + 1);
+        memcpy(sound.pattern, cpu->audio_pattern, AUDIO_PATTERN_SIZE);
+    }
+
+    if (memcmp(&sound, &published, sizeof(sound)) != 0) {
+        published = sound;
+        publish_sound(&sound);
     }
 }
 
@@ -3,5 +3,5 @@
 #include "chip8_t.h"
 
 bool audio_init(void);
-bool audio_update(chip8_t* cpu);
+void audio_update(const chip8_t* cpu);
 void audio_cleanup(void);
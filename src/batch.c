@@ -0,0 +1,206 @@
+#include "batch.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+// Instances not yet run this batch, owned by one worker
+typedef struct {
+    pthread_mutex_t lock;
+    int head;  // The owner runs instances from the front
+    int tail;  // Other workers steal from the back
+} queue_t;
+
+typedef struct {
+    batch_t* batch;
+    int index;
+} worker_t;
+
+struct batch {
+    chip8_t* instances;  // Contiguous, `count` machines
+    int count;
+    backend_t backend;
+
+    pthread_t* threads;
+    worker_t* workers;
+    queue_t* queues;  // One per worker
+    int thread_count;
+    int queue_count;  // Queues with a lock, set once the locks and condition variables below exist too
+
+    pthread_mutex_t lock;  // Guards everything below
+    pthread_cond_t start;  // Signaled when a new batch is started or the pool stops
+    pthread_cond_t done;   // Signaled when the last worker is done with the batch
+    uint64_t generation;   // Incremented for every batch
+    int active;            // Workers still running the current batch
+    bool is_stopping;
+
+    int frames;
+    int instructions_per_frame;
+    uint64_t instructions;  // Executed by all workers in the current batch
+};
+
+static int pop_instance(queue_t* queue, bool is_steal) {
+    pthread_mutex_lock(&queue->lock);
+    int index = -1;
+    if (queue->head < queue->tail) {
+        index = is_steal ? --queue->tail : queue->head++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return index;
+}
+
+static int next_instance(batch_t* batch, int worker) {
+    int index = pop_instance(&batch->queues[worker], false);
+
+    // Own queue is empty, steal from the others, as instances take uneven time to run their frames
+    for (int i = 1; index < 0 && i < batch->thread_count; i++) {
+        index = pop_instance(&batch->queues[(worker + i) % batch->thread_count], true);
+    }
+    return index;
+}
+
+static void* run_worker(void* arg) {
+    worker_t* worker = arg;
+    batch_t* batch = worker->batch;
+    uint64_t generation = 0;
+
+    while (true) {
+        pthread_mutex_lock(&batch->lock);
+        while (batch->generation == generation && !batch->is_stopping) {
+            pthread_cond_wait(&batch->start, &batch->lock);
+        }
+        if (batch->is_stopping) {
+            pthread_mutex_unlock(&batch->lock);
+            return NULL;
+        }
+        generation = batch->generation;
+        pthread_mutex_unlock(&batch->lock);
+
+        uint64_t executed = 0;
+        int index;
+        while ((index = next_instance(batch, worker->index)) >= 0) {
+            chip8_t* cpu = &batch->instances[index];
+            for (int frame = 0; frame < batch->frames; frame++) {
+                executed += run_chip8_frame(cpu, batch->backend, batch->instructions_per_frame);
+            }
+        }
+
+        pthread_mutex_lock(&batch->lock);
+        batch->instructions += executed;
+        if (--batch->active == 0) {
+            pthread_cond_signal(&batch->done);
+        }
+        pthread_mutex_unlock(&batch->lock);
+    }
+}
+
+batch_t* batch_create(int count, int thread_count, backend_t backend) {
+    if (count <= 0 || thread_count <= 0) {
+        return NULL;
+    }
+
+    batch_t* batch = calloc(1, sizeof(batch_t));
+    if (!batch) {
+        return NULL;
+    }
+    batch->count = count;
+    batch->backend = backend;
+    batch->instances = calloc(count, sizeof(chip8_t));
+    batch->threads = calloc(thread_count, sizeof(pthread_t));
+    batch->workers = calloc(thread_count, sizeof(worker_t));
+    batch->queues = calloc(thread_count, sizeof(queue_t));
+    if (!batch->instances || !batch->threads || !batch->workers || !batch->queues) {
+        batch_destroy(batch);
+        return NULL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        init_chip8(&batch->instances[i]);
+    }
+
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->start, NULL);
+    pthread_cond_init(&batch->done, NULL);
+    for (int i = 0; i < thread_count; i++) {
+        pthread_mutex_init(&batch->queues[i].lock, NULL);
+    }
+    batch->queue_count = thread_count;
+
+    for (int i = 0; i < thread_count; i++) {
+        batch->workers[i] = (worker_t){batch, i};
+        if (pthread_create(&batch->threads[i], NULL, run_worker, &batch->workers[i]) != 0) {
+            batch_destroy(batch);
+            return NULL;
+        }
+        batch->thread_count++;
+    }
+    return batch;
+}
+
+void batch_destroy(batch_t* batch) {
+    if (!batch) {
+        return;
+    }
+
+    if (batch->thread_count) {
+        pthread_mutex_lock(&batch->lock);
+        batch->is_stopping = true;
+        pthread_cond_broadcast(&batch->start);
+        pthread_mutex_unlock(&batch->lock);
+
+        for (int i = 0; i < batch->thread_count; i++) {
+            pthread_join(batch->threads[i], NULL);
+        }
+    }
+
+    // Nothing waits on them once the workers are joined
+    if (batch->queue_count) {
+        for (int i = 0; i < batch->queue_count; i++) {
+            pthread_mutex_destroy(&batch->queues[i].lock);
+        }
+        pthread_cond_destroy(&batch->done);
+        pthread_cond_destroy(&batch->start);
+        pthread_mutex_destroy(&batch->lock);
+    }
+
+    if (batch->instances) {
+        for (int i = 0; i < batch->count; i++) {
+            cleanup_chip8(&batch->instances[i]);
+        }
+    }
+    free(batch->instances);
+    free(batch->threads);
+    free(batch->workers);
+    free(batch->queues);
+    free(batch);
+}
+
+int batch_count(const batch_t* batch) {
+    return batch->count;
+}
+
+chip8_t* batch_get(batch_t* batch, int index) {
+    return &batch->instances[index];
+}
+
+uint64_t batch_run(batch_t* batch, int frames, int instructions_per_frame) {
+    // Deal the instances out in contiguous ranges, workers steal once they run out
+    for (int i = 0; i < batch->thread_count; i++) {
+        batch->queues[i].head = (int)((int64_t)batch->count * i / batch->thread_count);
+        batch->queues[i].tail = (int)((int64_t)batch->count * (i + 1) / batch->thread_count);
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    batch->frames = frames;
+    batch->instructions_per_frame = instructions_per_frame;
+    batch->instructions = 0;
+    batch->active = batch->thread_count;
+    batch->generation++;
+    pthread_cond_broadcast(&batch->start);
+    while (batch->active) {
+        pthread_cond_wait(&batch->done, &batch->lock);
+    }
+    uint64_t instructions = batch->instructions;
+    pthread_mutex_unlock(&batch->lock);
+
+    return instructions;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "chip8.h"
+
+typedef struct batch batch_t;
+
+// Instances are only touched by the workers inside `batch_run`, in between the caller owns them,
+// e.g. to load ROMs or to set each instance's keyboard
+batch_t* batch_create(int count, int thread_count, backend_t backend);
+void batch_destroy(batch_t* batch);
+int batch_count(const batch_t* batch);
+chip8_t* batch_get(batch_t* batch, int index);
+uint64_t batch_run(batch_t* batch, int frames, int instructions_per_frame);
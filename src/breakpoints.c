@@ -0,0 +1,295 @@
+#include "breakpoints.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "instructions.h"
+#include "profile.h"
+#include "quirks.h"
+
+// Memory an instruction accesses relative to I, computed before it runs since some ops move I
+typedef struct {
+    uint16_t address;
+    uint16_t size;  // 0 for instructions that don't access memory through I
+    bool is_write;
+} access_t;
+
+typedef access_t (*AccessFuncPtr)(const chip8_t* cpu, const instruction_t* instruction);
+
+static const char* const COMPARISON_NAMES[] = {
+    [COMPARE_EQUAL] = "==",
+    [COMPARE_NOT_EQUAL] = "!=",
+    [COMPARE_LESS] = "<",
+    [COMPARE_GREATER] = ">",
+};
+
+static access_t access_FX33(const chip8_t* cpu, const instruction_t* instruction) {
+    return (access_t){cpu->i, 3, true};
+}
+
+static access_t access_FX55(const chip8_t* cpu, const instruction_t* instruction) {
+    return (access_t){cpu->i, instruction->x + 1, true};
+}
+
+static access_t access_FX65(const chip8_t* cpu, const instruction_t* instruction) {
+    return (access_t){cpu->i, instruction->x + 1, false};
+}
+
+static access_t access_DXYN(const chip8_t* cpu, const instruction_t* instruction) {
+    // Each selected plane reads its own sprite, stored one after the other, DXY0 is 16 rows of 2 bytes
+    // with the big sprite quirk and reads nothing otherwise
+    int planes = (cpu->planes & 1) + ((cpu->planes >> 1) & 1);
+    int size = instruction->n ? instruction->n : (QUIRK_PROFILES[cpu->quirks].is_big_sprite ? 32 : 0);
+    return (access_t){cpu->i, size * planes, false};
+}
+
+static access_t access_5XY2(const chip8_t* cpu, const instruction_t* instruction) {
+    return (access_t){cpu->i, abs(instruction->x - instruction->y) + 1, true};
+}
+
+static access_t access_5XY3(const chip8_t* cpu, const instruction_t* instruction) {
+    return (access_t){cpu->i, abs(instruction->x - instruction->y) + 1, false};
+}
+
+static access_t access_F002(const chip8_t* cpu, const instruction_t* instruction) {
+    return (access_t){cpu->i, AUDIO_PATTERN_SIZE, false};
+}
+
+// Instrumented dispatch of the debugger, the memory accesses of every op that reads or writes through I
+static const AccessFuncPtr ACCESSES[OP_COUNT] = {
+    [OP_FX33] = access_FX33,
+    [OP_FX55] = access_FX55,
+    [OP_FX65] = access_FX65,
+    [OP_DXYN] = access_DXYN,
+    [OP_5XY2] = access_5XY2,
+    [OP_5XY3] = access_5XY3,
+    [OP_F002] = access_F002,
+};
+
+breakpoints_t* breakpoints_create(void) {
+    return calloc(1, sizeof(breakpoints_t));
+}
+
+void breakpoints_destroy(breakpoints_t* breakpoints) {
+    free(breakpoints);
+}
+
+bool has_breakpoints(const breakpoints_t* breakpoints) {
+    return breakpoints->address_count || breakpoints->watchpoint_count || breakpoints->condition_count;
+}
+
+bool add_breakpoint(breakpoints_t* breakpoints, uint16_t address) {
+    for (int i = 0; i < breakpoints->address_count; i++) {
+        if (breakpoints->addresses[i] == address) {
+            return true;
+        }
+    }
+    if (breakpoints->address_count == BREAKPOINTS_MAX) {
+        return false;
+    }
+    breakpoints->addresses[breakpoints->address_count++] = address;
+    return true;
+}
+
+bool remove_breakpoint(breakpoints_t* breakpoints, uint16_t address) {
+    for (int i = 0; i < breakpoints->address_count; i++) {
+        if (breakpoints->addresses[i] == address) {
+            breakpoints->addresses[i] = breakpoints->addresses[--breakpoints->address_count];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool add_watchpoint(breakpoints_t* breakpoints, watchpoint_t watchpoint) {
+    if (breakpoints->watchpoint_count == WATCHPOINTS_MAX) {
+        return false;
+    }
+    breakpoints->watchpoints[breakpoints->watchpoint_count++] = watchpoint;
+    return true;
+}
+
+bool add_condition(breakpoints_t* breakpoints, condition_t condition) {
+    if (breakpoints->condition_count == CONDITIONS_MAX) {
+        return false;
+    }
+    breakpoints->conditions[breakpoints->condition_count++] = condition;
+    return true;
+}
+
+// `ADDRESS[:SIZE][:r|w|rw]`, one byte read and written by default
+bool parse_watchpoint(const char* text, watchpoint_t* watchpoint) {
+    char* end;
+    unsigned long address = strtoul(text, &end, 0);
+    if (end == text || address >= MEMORY_SIZE) {
+        return false;
+    }
+    *watchpoint = (watchpoint_t){address, 1, true, true};
+
+    if (*end == ':' && isdigit((unsigned char)end[1])) {
+        const char* size = end + 1;
+        unsigned long value = strtoul(size, &end, 0);
+        if (end == size || value == 0 || value >= MEMORY_SIZE) {
+            return false;
+        }
+        watchpoint->size = value;
+    }
+    if (*end == ':') {
+        end++;
+        watchpoint->is_read = strcmp(end, "r") == 0 || strcmp(end, "rw") == 0;
+        watchpoint->is_write = strcmp(end, "w") == 0 || strcmp(end, "rw") == 0;
+        return watchpoint->is_read || watchpoint->is_write;
+    }
+    return *end == '\0';
+}
+
+// `VX` or `I`, a comparison out of `==`, `!=`, `<` and `>`, and a value, as in `V3==0x10`
+bool parse_condition(const char* text, condition_t* condition) {
+    *condition = (condition_t){0};
+    if (toupper((unsigned char)text[0]) == 'I') {
+        condition->reg = CONDITION_REGISTER_I;
+        text++;
+    } else if (toupper((unsigned char)text[0]) == 'V' && isxdigit((unsigned char)text[1])) {
+        char digit[2] = {text[1], '\0'};
+        condition->reg = strtoul(digit, NULL, 16);
+        text += 2;
+    } else {
+        return false;
+    }
+
+    int comparison = -1;
+    for (int i = 0; i < (int)(sizeof(COMPARISON_NAMES) / sizeof(COMPARISON_NAMES[0])); i++) {
+        size_t length = strlen(COMPARISON_NAMES[i]);
+        if (strncmp(text, COMPARISON_NAMES[i], length) == 0) {
+            comparison = i;
+            text += length;
+            break;
+        }
+    }
+    if (comparison < 0) {
+        return false;
+    }
+    condition->comparison = comparison;
+
+    char* end;
+    unsigned long value = strtoul(text, &end, 0);
+    uint32_t max = condition->reg == CONDITION_REGISTER_I ? 0xFFFF : 0xFF;
+    if (end == text || *end != '\0' || value > max) {
+        return false;
+    }
+    condition->value = value;
+    return true;
+}
+
+int format_condition(const condition_t* condition, char* text, int size) {
+    if (condition->reg == CONDITION_REGISTER_I) {
+        return snprintf(text, size, "I %s 0x%04X", COMPARISON_NAMES[condition->comparison], condition->value);
+    }
+    return snprintf(text, size, "V%X %s 0x%02X", condition->reg, COMPARISON_NAMES[condition->comparison], condition->value);
+}
+
+static bool is_condition_true(const chip8_t* cpu, const condition_t* condition) {
+    uint16_t value = condition->reg == CONDITION_REGISTER_I ? cpu->i : cpu->v[condition->reg];
+    switch (condition->comparison) {
+        case COMPARE_EQUAL:
+            return value == condition->value;
+        case COMPARE_NOT_EQUAL:
+            return value != condition->value;
+        case COMPARE_LESS:
+            return value < condition->value;
+        case COMPARE_GREATER:
+            return value > condition->value;
+    }
+    return false;
+}
+
+// Whether two ranges of memory overlap, both may wrap around the end of memory
+static bool is_overlapping(uint16_t a, uint16_t a_size, uint16_t b, uint16_t b_size) {
+    return (uint16_t)(b - a) < a_size || (uint16_t)(a - b) < b_size;
+}
+
+static bool stop(breakpoints_t* breakpoints, stop_reason_t reason, uint16_t pc, int index) {
+    breakpoints->is_stopped = true;
+    breakpoints->stop_reason = reason;
+    breakpoints->stop_pc = pc;
+    breakpoints->stop_index = index;
+    breakpoints->is_resuming = reason == STOP_BREAKPOINT;
+    return true;
+}
+
+// Checks what the instruction at `pc` just did against the watchpoints and conditions
+static bool is_stopped_after(chip8_t* cpu, uint16_t pc, access_t access) {
+    breakpoints_t* breakpoints = cpu->breakpoints;
+    bool is_stopped = false;
+
+    // A waiting instruction didn't access anything yet
+    if (access.size && !cpu->wait_state) {
+        for (int i = 0; i < breakpoints->watchpoint_count; i++) {
+            const watchpoint_t* watchpoint = &breakpoints->watchpoints[i];
+            if ((access.is_write ? watchpoint->is_write : watchpoint->is_read) &&
+                is_overlapping(access.address, access.size, watchpoint->address, watchpoint->size)) {
+                is_stopped = stop(breakpoints, access.is_write ? STOP_WATCH_WRITE : STOP_WATCH_READ, pc, i);
+                break;
+            }
+        }
+    }
+
+    // Every condition follows the registers, even once one of them stopped the run
+    for (int i = 0; i < breakpoints->condition_count; i++) {
+        condition_t* condition = &breakpoints->conditions[i];
+        bool is_true = is_condition_true(cpu, condition);
+        if (is_true && !condition->was_true && !is_stopped) {
+            is_stopped = stop(breakpoints, STOP_CONDITION, pc, i);
+        }
+        condition->was_true = is_true;
+    }
+    return is_stopped;
+}
+
+// Interprets with every instruction checked against the breakpoints, only used while there are any, so runs
+// without them pay nothing, returns the instructions run, less than `budget` if one stopped the run or started waiting
+int run_breakpoints(chip8_t* cpu, int budget) {
+    breakpoints_t* breakpoints = cpu->breakpoints;
+
+    // Resuming from a breakpoint runs its instruction, rather than stopping on it again
+    bool is_resuming = breakpoints->is_resuming;
+    breakpoints->is_resuming = false;
+    breakpoints->stop_reason = STOP_NONE;
+
+    // Only instructions stop on a condition, one that already holds as the run starts, because it was just
+    // added or a state load or rewind set the registers, waits for its next transition
+    for (int i = 0; i < breakpoints->condition_count; i++) {
+        breakpoints->conditions[i].was_true = is_condition_true(cpu, &breakpoints->conditions[i]);
+    }
+
+    int executed = 0;
+    while (executed < budget) {
+        uint16_t pc = cpu->pc;
+        if (!is_resuming) {
+            for (int i = 0; i < breakpoints->address_count; i++) {
+                if (breakpoints->addresses[i] == pc) {
+                    stop(breakpoints, STOP_BREAKPOINT, pc, i);
+                    return executed;
+                }
+            }
+        }
+        is_resuming = false;
+
+        const instruction_t* instruction = fetch_instruction(cpu, pc);
+        AccessFuncPtr get_access = ACCESSES[instruction->op];
+        access_t access = get_access ? get_access(cpu, instruction) : (access_t){0};
+
+        if (cpu->profile) {
+            profile_step(cpu);
+        } else {
+            step_chip8(cpu);
+        }
+        executed++;
+
+        if (is_stopped_after(cpu, pc, access) || cpu->wait_state) break;
+    }
+    return executed;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "chip8_t.h"
+
+#define BREAKPOINTS_MAX 16
+#define WATCHPOINTS_MAX 16
+#define CONDITIONS_MAX 16
+#define CONDITION_REGISTER_I REGISTERS_COUNT  // `condition_t` register that stands for I
+
+// Why the last run stopped early
+typedef enum {
+    STOP_NONE,
+    STOP_BREAKPOINT,   // The program counter reached a breakpoint, before running its instruction
+    STOP_WATCH_READ,   // An instruction read watched memory, after running it
+    STOP_WATCH_WRITE,  // An instruction wrote watched memory, after running it
+    STOP_CONDITION,    // A register condition became true, after the instruction that changed it
+} stop_reason_t;
+
+typedef enum {
+    COMPARE_EQUAL,
+    COMPARE_NOT_EQUAL,
+    COMPARE_LESS,
+    COMPARE_GREATER,
+} comparison_t;
+
+typedef struct {
+    uint16_t address;
+    uint16_t size;
+    bool is_read;   // Stop on FX65, DXYN, 5XY3 and F002 reading the range
+    bool is_write;  // Stop on FX33, FX55 and 5XY2 writing the range
+} watchpoint_t;
+
+typedef struct {
+    uint8_t reg;         // V0-VF, or `CONDITION_REGISTER_I`
+    uint8_t comparison;  // `comparison_t`
+    uint16_t value;
+    bool was_true;  // Conditions stop when an instruction makes them true, not for as long as they hold
+} condition_t;
+
+struct breakpoints {
+    uint16_t addresses[BREAKPOINTS_MAX];
+    int address_count;
+    watchpoint_t watchpoints[WATCHPOINTS_MAX];
+    int watchpoint_count;
+    condition_t conditions[CONDITIONS_MAX];
+    int condition_count;
+
+    bool is_stopped;      // Set when a run stops early, cleared by the debugger once it paused
+    bool is_resuming;     // The next run starts with the instruction at the PC, even if it holds a breakpoint
+    uint8_t stop_reason;  // `stop_reason_t` of the last stop, cleared when the next run starts
+    uint16_t stop_pc;     // Address of the instruction that stopped the run
+    uint16_t stop_index;  // Breakpoint, watchpoint or condition that stopped the run
+};
+
+breakpoints_t* breakpoints_create(void);
+void breakpoints_destroy(breakpoints_t* breakpoints);
+bool has_breakpoints(const breakpoints_t* breakpoints);
+bool add_breakpoint(breakpoints_t* breakpoints, uint16_t address);
+bool remove_breakpoint(breakpoints_t* breakpoints, uint16_t address);
+bool add_watchpoint(breakpoints_t* breakpoints, watchpoint_t watchpoint);
+bool add_condition(breakpoints_t* breakpoints, condition_t condition);
+bool parse_watchpoint(const char* text, watchpoint_t* watchpoint);
+bool parse_condition(const char* text, condition_t* condition);
+int format_condition(const condition_t* condition, char* text, int size);
+int run_breakpoints(chip8_t* cpu, int budget);
@@ -3,14 +3,42 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "aot.h"
+#include "breakpoints.h"
+#include "idle.h"
 #include "instructions.h"
+#include "jit.h"
+#include "profile.h"
+#include "threaded.h"
 
 void init_chip8(chip8_t* cpu) {
+    // Build the opcode dispatch table
+    init_instructions();
+
     // Copy fontset to memory
     memcpy(cpu->memory + FONTSET_START_ADDR, FONTSET, FONTSET_SIZE);
+    memcpy(cpu->memory + BIG_FONTSET_START_ADDR, BIG_FONTSET, BIG_FONTSET_SIZE);
 
     // Set program counter to start address
     cpu->pc = PC_START_ADDR;
+
+    // XO-CHIP draws in the first plane until FN01 selects others
+    cpu->planes = 1;
+
+    // XO-CHIP plays the audio pattern at 4000 samples per second by default
+    cpu->audio_pitch = AUDIO_DEFAULT_PITCH;
+
+    // Fixed default seed, so headless runs are reproducible
+    seed_chip8(cpu, 0);
+}
+
+void cleanup_chip8(chip8_t* cpu) {
+    jit_destroy(cpu->jit);
+    cpu->jit = NULL;
+    profile_destroy(cpu->profile);
+    cpu->profile = NULL;
+    breakpoints_destroy(cpu->breakpoints);
+    cpu->breakpoints = NULL;
 }
 
 bool load_rom(chip8_t* cpu, const char* filename) {
@@ -25,16 +53,46 @@ bool load_rom(chip8_t* cpu, const char* filename) {
     if (bytes_read == 0) {
         return false;
     }
+
+    invalidate_chip8_cache(cpu, PC_START_ADDR, bytes_read);
     return true;
 }
 
+static uint16_t read_opcode(const chip8_t* cpu, uint16_t address) {
+    return (cpu->memory[address] << 8) | cpu->memory[(uint16_t)(address + 1)];
+}
+
+instruction_t* fetch_instruction(chip8_t* cpu, uint16_t address) {
+    instruction_t* instruction = &cpu->cache[address & (DECODE_CACHE_SIZE - 1)];
+
+    // Decode on first execution of this address, or when the slot holds another address mapped to it
+    if (!instruction->handler || instruction->address != address) {
+        // Blocks running through the slot were built for the other address
+        if (instruction->handler) {
+            for (int i = -2 * BLOCK_MAX_LENGTH; i <= 0; i++) {
+                cpu->cache[(address + i) & (DECODE_CACHE_SIZE - 1)].block_length = 0;
+            }
+        }
+
+        *instruction = decode_instruction(read_opcode(cpu, address), cpu->quirks);
+        instruction->address = address;
+
+        // Operands in the next word, which `invalidate_chip8_cache` treats as part of this instruction
+        uint16_t next = read_opcode(cpu, address + 2);
+        if (instruction->op == OP_F000) {
+            instruction->nnn = next;
+        }
+        if (next == 0xF000) {
+            instruction->skip = 4;  // Skips jump over the whole double-wide instruction
+        }
+    }
+    return instruction;
+}
+
 void step_chip8(chip8_t* cpu) {
-    uint16_t opcode = (cpu->memory[cpu->pc] << 8) | cpu->memory[cpu->pc + 1];
+    instruction_t* instruction = fetch_instruction(cpu, cpu->pc);
     cpu->pc += 2;
-    OpFuncPtr instruction = get_instruction(opcode);
-    if (instruction) {
-        instruction(cpu, opcode);
-    }
+    instruction->handler(cpu, instruction);
 }
 
 void step_chip8_timer(chip8_t* cpu) {
@@ -45,3 +103,210 @@ void step_chip8_timer(chip8_t* cpu) {
         cpu->sound_timer--;
     }
 }
+
+void seed_chip8(chip8_t* cpu, uint64_t seed) {
+    // Mix the seed with splitmix64, xorshift needs a non-zero state and close seeds should give unrelated sequences
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    cpu->random_state = z ? z : 1;
+}
+
+void set_chip8_random_source(chip8_t* cpu, RandomFuncPtr source, void* context) {
+    // NULL goes back to the built-in generator
+    cpu->random_source = source;
+    cpu->random_context = context;
+}
+
+uint8_t next_chip8_random(chip8_t* cpu) {
+    if (cpu->random_source) {
+        return cpu->random_source(cpu->random_context);
+    }
+
+    uint64_t x = cpu->random_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    cpu->random_state = x;
+    return x >> 56;
+}
+
+// Ends a wait whose condition came true, returns whether the CPU can run
+bool wake_chip8(chip8_t* cpu) {
+    switch (cpu->wait_state) {
+        case WAIT_VBLANK:
+            if (cpu->is_redraw_needed) {
+                return false;
+            }
+            break;  // DXYN runs again and draws
+        case WAIT_KEY_PRESS:
+            for (int i = 0; i < KEYBOARD_SIZE; i++) {
+                if (cpu->keyboard[i]) {
+                    cpu->wait_key = i;
+                    cpu->wait_state = WAIT_KEY_RELEASE;
+                    break;
+                }
+            }
+            return false;
+        case WAIT_KEY_RELEASE:
+            if (cpu->keyboard[cpu->wait_key]) {
+                return false;
+            }
+            // FX0A finishes with the released key
+            cpu->v[fetch_instruction(cpu, cpu->pc)->x] = cpu->wait_key;
+            cpu->pc += 2;
+            break;
+    }
+    cpu->wait_state = WAIT_NONE;
+    return true;
+}
+
+// Runs a budget of instruction slots, returns the instructions retired, which leaves out
+// the slots slept through by a waiting CPU and the polling loop iterations skipped
+int run_chip8(chip8_t* cpu, backend_t backend, int budget) {
+    // A waiting CPU sleeps through the rest of the budget, it can only wake up in between runs,
+    // on a vblank or a key event, so the backends stop as soon as an instruction starts waiting
+    int executed = 0;
+    int retired = 0;
+    bool is_awake = wake_chip8(cpu);
+    if (cpu->breakpoints && has_breakpoints(cpu->breakpoints) && is_awake) {
+        // The debugger checks every instruction, polling loops are run rather than skipped, so none of them is missed
+        executed = run_breakpoints(cpu, budget);
+        retired = executed;
+    } else if (cpu->profile && is_awake) {
+        // Profiling counts every instruction, so it always runs in the interpreter
+        while (executed < budget) {
+            profile_step(cpu);
+            executed++;
+            if (cpu->wait_state) break;
+        }
+        retired = executed;
+    } else if (is_awake) {
+        // Polling loops only repeat themselves until the next timer tick or key event, skip them
+        executed = skip_idle_loop(cpu, budget, &retired);
+        int count = 0;
+        switch (backend) {
+            case BACKEND_THREADED:
+                count = run_threaded(cpu, budget - executed);
+                break;
+            case BACKEND_JIT:
+                count = run_jit(cpu, budget - executed);
+                break;
+            case BACKEND_AOT:
+                count = run_aot(cpu, budget - executed);
+                break;
+            case BACKEND_INTERP:
+                while (executed + count < budget) {
+                    step_chip8(cpu);
+                    count++;
+                    if (cpu->wait_state) break;
+                }
+                break;
+        }
+        executed += count;
+        retired += count;
+    }
+
+    if (cpu->profile) {
+        cpu->profile->idle += budget - executed;
+    }
+
+    cpu->instruction_count += budget;
+    return retired;
+}
+
+int run_chip8_frame(chip8_t* cpu, backend_t backend, int budget) {
+    // Headless frame: a batch of instructions followed by a timer tick and a vblank
+    int executed = run_chip8(cpu, backend, budget);
+    step_chip8_timer(cpu);
+    cpu->is_redraw_needed = false;
+    if (cpu->profile) {
+        profile_frame(cpu->profile);
+    }
+    return executed;
+}
+
+// Drops the decoded instructions, basic blocks and JIT code reading a range of memory
+static void invalidate_decoded(chip8_t* cpu, uint16_t address, uint16_t size) {
+    // Instructions starting up to three bytes before the written range read it as well, as the second word
+    // of F000 NNNN or the next opcode that decides how far a skip jumps, slots of other addresses mapped
+    // to the range only get decoded again
+    int count = size < DECODE_CACHE_SIZE ? size : DECODE_CACHE_SIZE;
+    for (int i = -3; i < count; i++) {
+        cpu->cache[(address + i) & (DECODE_CACHE_SIZE - 1)].handler = NULL;
+    }
+
+    // Basic blocks starting before the written range may run into it, or end in a skip reading it
+    for (int i = -2 * BLOCK_MAX_LENGTH - 2; i < count; i++) {
+        cpu->cache[(address + i) & (DECODE_CACHE_SIZE - 1)].block_length = 0;
+    }
+
+    if (cpu->jit) {
+        jit_invalidate(cpu->jit, address, size);
+    }
+}
+
+void set_chip8_quirks(chip8_t* cpu, quirks_t quirks) {
+    // Instructions already decoded or compiled follow the previous profile, drop them all,
+    // the JIT starts over rather than leave every block to the interpreter, memory is unchanged
+    // so code compiled ahead of time stays valid, it checks the profile itself
+    cpu->quirks = quirks;
+    jit_destroy(cpu->jit);
+    cpu->jit = NULL;
+    invalidate_decoded(cpu, 0, DECODE_CACHE_SIZE);
+}
+
+bool parse_backend(const char* name, backend_t* backend) {
+    if (strcmp(name, "interp") == 0) {
+        *backend = BACKEND_INTERP;
+        return true;
+    }
+    if (strcmp(name, "threaded") == 0) {
+        *backend = BACKEND_THREADED;
+        return true;
+    }
+    if (strcmp(name, "jit") == 0) {
+        *backend = BACKEND_JIT;
+        return true;
+    }
+    if (strcmp(name, "aot") == 0) {
+        *backend = BACKEND_AOT;
+        return true;
+    }
+    return false;
+}
+
+bool is_chip8_state_equal(const chip8_t* a, const chip8_t* b) {
+    // Compare everything a ROM can observe, caches and backend state are left out
+    return memcmp(a->memory, b->memory, sizeof(a->memory)) == 0 &&
+           a->pc == b->pc &&
+           memcmp(a->stack, b->stack, sizeof(a->stack)) == 0 &&
+           a->sp == b->sp &&
+           memcmp(a->v, b->v, sizeof(a->v)) == 0 &&
+           a->i == b->i &&
+           a->delay_timer == b->delay_timer &&
+           a->sound_timer == b->sound_timer &&
+           memcmp(a->audio_pattern, b->audio_pattern, sizeof(a->audio_pattern)) == 0 &&
+           a->audio_pitch == b->audio_pitch &&
+           a->is_audio_pattern == b->is_audio_pattern &&
+           memcmp(a->display, b->display, sizeof(a->display)) == 0 &&
+           a->is_hires == b->is_hires &&
+           a->planes == b->planes &&
+           memcmp(a->rpl_flags, b->rpl_flags, sizeof(a->rpl_flags)) == 0 &&
+           a->is_redraw_needed == b->is_redraw_needed &&
+           memcmp(a->keyboard, b->keyboard, sizeof(a->keyboard)) == 0 &&
+           a->wait_state == b->wait_state &&
+           a->wait_key == b->wait_key &&
+           a->instruction_count == b->instruction_count &&
+           a->random_state == b->random_state;
+}
+
+void invalidate_chip8_cache(chip8_t* cpu, uint16_t address, uint16_t size) {
+    invalidate_decoded(cpu, address, size);
+
+    // Code compiled ahead of time from these lines is compared with the ROM before it runs again
+    for (int line = address / WRITTEN_LINE_SIZE; line <= (address + size - 1) / WRITTEN_LINE_SIZE; line++) {
+        cpu->written_lines[(line % WRITTEN_LINES_COUNT) / 64] |= 1ull << (line % 64);
+    }
+}
@@ -2,7 +2,44 @@
 
 #include "chip8_t.h"
 
+typedef enum {
+    BACKEND_INTERP,    // Decode and dispatch one instruction at a time
+    BACKEND_THREADED,  // Run whole basic blocks with threaded dispatch
+    BACKEND_JIT,       // Compile hot basic blocks to native code
+    BACKEND_AOT,       // Run the ROM compiled ahead of time by `chip8-aot`, see `aot.h`
+} backend_t;
+
 void init_chip8(chip8_t* cpu);
+void cleanup_chip8(chip8_t* cpu);
 bool load_rom(chip8_t* cpu, const char* filename);
 void step_chip8(chip8_t* cpu);
 void step_chip8_timer(chip8_t* cpu);
+void seed_chip8(chip8_t* cpu, uint64_t seed);
+void set_chip8_random_source(chip8_t* cpu, RandomFuncPtr source, void* context);
+uint8_t next_chip8_random(chip8_t* cpu);
+void set_chip8_quirks(chip8_t* cpu, quirks_t quirks);
+int run_chip8(chip8_t* cpu, backend_t backend, int budget);
+int run_chip8_frame(chip8_t* cpu, backend_t backend, int budget);
+bool parse_backend(const char* name, backend_t* backend);
+bool wake_chip8(chip8_t* cpu);
+bool is_chip8_state_equal(const chip8_t* a, const chip8_t* b);
+instruction_t* fetch_instruction(chip8_t* cpu, uint16_t address);
+void invalidate_chip8_cache(chip8_t* cpu, uint16_t address, uint16_t size);
+
+// Size of the display in the current mode
+static inline int get_display_width(const chip8_t* cpu) {
+    return cpu->is_hires ? DISPLAY_WIDTH : LORES_WIDTH;
+}
+
+static inline int get_display_height(const chip8_t* cpu) {
+    return cpu->is_hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+}
+
+// Color of a pixel, its bit in each plane
+static inline uint8_t get_display_pixel(const chip8_t* cpu, int x, int y) {
+    uint8_t color = 0;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        color |= ((cpu->display[plane][y][x / 64] >> (63 - x % 64)) & 1) << plane;
+    }
+    return color;
+}
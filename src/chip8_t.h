@@ -4,14 +4,31 @@
 #include <stdint.h>
 
 #define FONTSET_SIZE 80
-#define MEMORY_SIZE 4096
+#define BIG_FONTSET_SIZE 160
+#define MEMORY_SIZE 0x10000  // XO-CHIP 64KB address space
+#define DECODE_CACHE_SIZE 4096  // Slots of the direct-mapped decode cache
 #define STACK_SIZE 16
 #define REGISTERS_COUNT 16
-#define DISPLAY_WIDTH 64
-#define DISPLAY_HEIGHT 32
+#define DISPLAY_WIDTH 128  // SUPER-CHIP hi-res, lo-res uses the top left 64x32 pixels
+#define DISPLAY_HEIGHT 64
+#define DISPLAY_WORDS (DISPLAY_WIDTH / 64)  // Words per display row
+#define DISPLAY_PLANES 2                    // XO-CHIP bitplanes, a pixel's color is its bit in each plane
+#define LORES_WIDTH 64
+#define LORES_HEIGHT 32
 #define KEYBOARD_SIZE 16
+#define RPL_FLAGS_COUNT 16  // SUPER-CHIP has 8 HP-48 RPL flags, XO-CHIP 16
+#define AUDIO_PATTERN_SIZE 16  // Bytes of the XO-CHIP audio pattern, 128 one-bit samples
+#define AUDIO_DEFAULT_PITCH 64  // FX3A value playing the audio pattern at 4000 samples per second
+
+#define DISPLAY_ALL_ROWS UINT64_MAX  // `dirty_rows` with every row set
+
+#define BLOCK_MAX_LENGTH 32  // Longest basic block built by the threaded backend
+
+#define WRITTEN_LINE_SIZE 64  // Bytes of memory per bit of `written_lines`
+#define WRITTEN_LINES_COUNT (MEMORY_SIZE / WRITTEN_LINE_SIZE)
 
 #define FONTSET_START_ADDR 0x50
+#define BIG_FONTSET_START_ADDR (FONTSET_START_ADDR + FONTSET_SIZE)
 #define PC_START_ADDR 0x200
 
 static const uint8_t FONTSET[FONTSET_SIZE] = {
@@ -33,8 +50,70 @@ static const uint8_t FONTSET[FONTSET_SIZE] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80   // F
 };
 
-typedef struct {
-    uint8_t memory[MEMORY_SIZE];  // 4KB RAM memory
+// SUPER-CHIP 8x10 digits of FX30, with the XO-CHIP letters
+static const uint8_t BIG_FONTSET[BIG_FONTSET_SIZE] = {
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C,  // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C,  // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF,  // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C,  // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06,  // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C,  // 5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C,  // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60,  // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C,  // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C,  // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,  // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,  // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,  // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,  // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,  // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0   // F
+};
+
+typedef struct chip8 chip8_t;
+typedef struct instruction instruction_t;
+typedef struct jit jit_t;
+typedef struct aot aot_t;
+typedef struct profile profile_t;
+typedef struct breakpoints breakpoints_t;
+
+typedef void (*OpFuncPtr)(chip8_t*, const instruction_t*);
+typedef uint8_t (*RandomFuncPtr)(void* context);
+
+// What a halted CPU waits for, the program counter stays on the waiting instruction
+typedef enum {
+    WAIT_NONE,
+    WAIT_VBLANK,       // DXYN, for the display to be presented
+    WAIT_KEY_PRESS,    // FX0A, for any key to be pressed
+    WAIT_KEY_RELEASE,  // FX0A, for `wait_key` to be released
+} wait_state_t;
+
+// Behaviour of the ambiguous instructions, which differ between interpreters, see `quirks.h`
+typedef enum {
+    QUIRKS_VIP,     // COSMAC VIP, the original interpreter
+    QUIRKS_CHIP48,  // CHIP-48 on the HP-48
+    QUIRKS_SCHIP,   // SUPER-CHIP 1.1
+    QUIRKS_XOCHIP,  // XO-CHIP, as in Octo
+    QUIRKS_COUNT
+} quirks_t;
+
+// Opcode with its operands already extracted
+struct instruction {
+    OpFuncPtr handler;     // Handler to execute, NULL for an empty cache entry
+    uint16_t address;      // Address the instruction was decoded from, tags its decode cache slot
+    uint16_t opcode;       // Raw opcode
+    uint16_t nnn;          // Lowest 12 bits, address operand, the whole second word of F000 NNNN
+    uint8_t x;             // Second nibble, register operand
+    uint8_t y;             // Third nibble, register operand
+    uint8_t n;             // Lowest nibble
+    uint8_t nn;            // Lowest byte, value operand
+    uint8_t op;            // Decoded `op_t`, used by the threaded backend
+    uint8_t skip;          // Bytes a taken skip jumps over, 4 when the next instruction is F000 NNNN
+    uint8_t block_length;  // Instructions in the basic block starting here, 0 if not built yet
+};
+
+struct chip8 {
+    uint8_t memory[MEMORY_SIZE];  // 64KB RAM memory
     uint16_t pc;                  // Program counter register
 
     uint16_t stack[STACK_SIZE];  // Call stack for subroutines
@@ -46,8 +125,38 @@ typedef struct {
     uint8_t delay_timer;  // Delay timer, decrements at 60Hz
     uint8_t sound_timer;  // Sound timer, decrements at 60Hz, beeps when >0
 
-    bool display[DISPLAY_WIDTH * DISPLAY_HEIGHT];  // 64x32 monochrome display buffer
-    bool is_redraw_needed;                         // Display refresh flag
+    uint8_t audio_pattern[AUDIO_PATTERN_SIZE];  // XO-CHIP 1-bit samples played while the sound timer runs, set by F002
+    uint8_t audio_pitch;                        // XO-CHIP playback rate of `audio_pattern`, set by FX3A
+    bool is_audio_pattern;                      // Set by F002, the buzzer plays its plain tone until then
+
+    uint64_t display[DISPLAY_PLANES][DISPLAY_HEIGHT][DISPLAY_WORDS];  // Bitplanes, MSB of the first word is the leftmost pixel
+    bool is_hires;                                                    // SUPER-CHIP 128x64 mode, lo-res only uses the first word of the top 32 rows
+    uint8_t planes;                                                   // XO-CHIP bitmask of the planes drawn, cleared and scrolled, set by FN01
+    bool is_redraw_needed;                                            // Display refresh flag
+    uint64_t dirty_rows;                                              // Bit per display row changed since the frontend took them, bit 0 is the top row
+
+    uint8_t rpl_flags[RPL_FLAGS_COUNT];  // SUPER-CHIP HP-48 RPL user flags, saved by FX75 and loaded by FX85
 
     bool keyboard[KEYBOARD_SIZE];  // 16-key hexadecimal keypad state
-} chip8_t;
+
+    uint8_t wait_state;  // `wait_state_t`, the rest of the frame is skipped while the condition holds
+    uint8_t wait_key;    // Key pressed during FX0A, stored in VX once released
+
+    uint8_t quirks;  // `quirks_t`, set with `set_chip8_quirks` so decoded instructions pick up its handlers
+
+    bool is_illegal;          // Set once an illegal opcode is executed
+    uint16_t illegal_opcode;  // Last illegal opcode executed
+
+    uint64_t instruction_count;  // Instruction slots run by `run_chip8`, waits included, the time base of recorded input
+
+    uint64_t random_state;        // xorshift64 state for CXNN, set by `seed_chip8`
+    RandomFuncPtr random_source;  // Replaces the built-in generator when set
+    void* random_context;         // Passed to `random_source`
+
+    instruction_t cache[DECODE_CACHE_SIZE];            // Predecoded instructions, slot per address modulo the size, filled lazily
+    jit_t* jit;                                        // Native code of the JIT backend, created on first use
+    const aot_t* aot;                                  // ROM compiled ahead of time, run by the AOT backend, set by `set_chip8_aot`
+    uint64_t written_lines[WRITTEN_LINES_COUNT / 64];  // Bit per line of memory that may differ from the ROM of `aot`
+    profile_t* profile;                                // Execution counters, profiling is off while NULL
+    breakpoints_t* breakpoints;                        // Stops of the debugger, checked by an instrumented interpreter while it holds any
+};
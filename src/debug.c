@@ -1,30 +1,147 @@
 #include "debug.h"
 
+#include <SDL3/SDL_timer.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "breakpoints.h"
 #include "chip8_t.h"
+#include "profile.h"
 
 #define DEBUGGER_COLS 16
 #define DEBUGGER_ROWS 16
 #define DEBUGGER_PAGE_SIZE (DEBUGGER_COLS * DEBUGGER_ROWS)
 
-#define DEBUGGER_MODE_COUNT 2
+#define DEBUGGER_MODE_COUNT 3
 typedef enum {
     OVERVIEW,
     MEMORY_DUMP,
+    PROFILE,
 } debugger_mode_t;
 static debugger_mode_t mode = OVERVIEW;
 
 static const int DEBUGGER_PAGE_COUNT = MEMORY_SIZE / DEBUGGER_PAGE_SIZE + (MEMORY_SIZE % DEBUGGER_PAGE_SIZE ? 1 : 0);
 static int page = 0;
 
+#define SCREEN_ROWS 24
+#define SCREEN_COLS 80
+#define SCREEN_GAP_MAX 6  // Unchanged cells rewritten rather than jumped over
+#define SCREEN_REFRESH_NS (1000000000ull / 15)  // Redraw at most 15 times a second, whatever the emulation speed
+
+// Cells drawn by the current refresh, and the cells the terminal shows, only the differences are written
+static char screen[SCREEN_ROWS][SCREEN_COLS];
+static char shown[SCREEN_ROWS][SCREEN_COLS];
+static bool is_shown = false;  // Whether the terminal was cleared, so `shown` holds what it displays
+static uint64_t next_refresh_ns = 0;
+
+// Terminal output of one refresh, room for a cursor move or a gap before every cell
+static char output[SCREEN_ROWS * SCREEN_COLS * 12];
+static size_t output_size = 0;
+
+// Draws text into the screen model, rows and columns start at 1 as in terminal cursor moves
 void printf_at(int i, int j, const char* format, ...) {
+    char text[SCREEN_COLS + 1];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (i < 1 || i > SCREEN_ROWS || j < 1) {
+        return;
+    }
+    for (int k = 0; text[k] && text[k] != '\n' && j - 1 + k < SCREEN_COLS; k++) {
+        screen[i - 1][j - 1 + k] = text[k];
+    }
+}
+
+static void emit(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    printf("\033[%d;%dH", i, j);
-    vprintf(format, args);
+    int size = vsnprintf(output + output_size, sizeof(output) - output_size, format, args);
     va_end(args);
+    if (size > 0 && (size_t)size < sizeof(output) - output_size) {
+        output_size += size;
+    }
+}
+
+// Writes the cells that changed since the last refresh to the terminal, in a single write
+static void flush_screen(void) {
+    output_size = 0;
+    if (!is_shown) {
+        emit("\033[2J");
+        memset(shown, ' ', sizeof(shown));
+        is_shown = true;
+    }
+
+    int cursor_row = -1;
+    int cursor_col = -1;
+    for (int row = 0; row < SCREEN_ROWS; row++) {
+        for (int col = 0; col < SCREEN_COLS; col++) {
+            if (screen[row][col] == shown[row][col]) {
+                continue;
+            }
+            // Rewrite a short gap of unchanged cells, it's shorter than a cursor move
+            if (row == cursor_row && col > cursor_col && col - cursor_col < SCREEN_GAP_MAX) {
+                memcpy(output + output_size, &screen[row][cursor_col], col - cursor_col);
+                output_size += col - cursor_col;
+            } else if (row != cursor_row || col != cursor_col) {
+                emit("\033[%d;%dH", row + 1, col + 1);
+            }
+            output[output_size++] = screen[row][col];
+            shown[row][col] = screen[row][col];
+            cursor_row = row;
+            cursor_col = col + 1;
+        }
+    }
+    if (!output_size) {
+        return;
+    }
+    emit("\033[%d;1H", SCREEN_ROWS + 1);  // Park the cursor below the debugger
+
+    for (size_t written = 0; written < output_size;) {
+        ssize_t size = write(STDOUT_FILENO, output + written, output_size - written);
+        if (size <= 0) {
+            break;
+        }
+        written += size;
+    }
+}
+
+void debug_breakpoints(const breakpoints_t* breakpoints) {
+    // Print why the emulation stopped
+    char condition[32];
+    switch (breakpoints->stop_reason) {
+        case STOP_BREAKPOINT:
+            printf_at(10, 35, "Stopped: Break at 0x%04X", breakpoints->stop_pc);
+            break;
+        case STOP_WATCH_READ:
+        case STOP_WATCH_WRITE:
+            printf_at(10, 35, "Stopped: %s 0x%04X at 0x%04X", breakpoints->stop_reason == STOP_WATCH_READ ? "Read" : "Write",
+                      breakpoints->watchpoints[breakpoints->stop_index].address, breakpoints->stop_pc);
+            break;
+        case STOP_CONDITION:
+            format_condition(&breakpoints->conditions[breakpoints->stop_index], condition, sizeof(condition));
+            printf_at(10, 35, "Stopped: %s at 0x%04X", condition, breakpoints->stop_pc);
+            break;
+    }
+
+    // Print breakpoints, watchpoints and conditions, as many as fit
+    int row = 12;
+    printf_at(row++, 35, "Breakpoints (B toggles at PC):");
+    for (int i = 0; i < breakpoints->address_count; i++) {
+        printf_at(row++, 35, "Break 0x%04X", breakpoints->addresses[i]);
+    }
+    for (int i = 0; i < breakpoints->watchpoint_count; i++) {
+        const watchpoint_t* watchpoint = &breakpoints->watchpoints[i];
+        printf_at(row++, 35, "Watch 0x%04X+%u %s%s", watchpoint->address, watchpoint->size,
+                  watchpoint->is_read ? "r" : "", watchpoint->is_write ? "w" : "");
+    }
+    for (int i = 0; i < breakpoints->condition_count; i++) {
+        format_condition(&breakpoints->conditions[i], condition, sizeof(condition));
+        printf_at(row++, 35, "If %s", condition);
+    }
 }
 
 void debug_overview(chip8_t* chip8) {
@@ -49,8 +166,14 @@ void debug_overview(chip8_t* chip8) {
     printf_at(5, 35, "Delay Timer: %d", chip8->delay_timer);
     printf_at(6, 35, "Sound Timer: %d", chip8->sound_timer);
 
-    // Move to new row
-    printf_at(STACK_SIZE + 2, 1, "");
+    // Print last illegal opcode
+    if (chip8->is_illegal) {
+        printf_at(8, 35, "Illegal Opcode: 0x%04X", chip8->illegal_opcode);
+    }
+
+    if (chip8->breakpoints) {
+        debug_breakpoints(chip8->breakpoints);
+    }
 }
 
 void debug_memory_dump(chip8_t* chip8, int page) {
@@ -68,15 +191,56 @@ void debug_memory_dump(chip8_t* chip8, int page) {
         // Data columns
         printf_at(i / DEBUGGER_COLS % DEBUGGER_ROWS + 2, 6 + (i % DEBUGGER_COLS) * 3, "%02X", chip8->memory[i]);
     }
+}
+
+void debug_profile(chip8_t* chip8) {
+    const profile_t* profile = chip8->profile;
+    if (!profile) {
+        printf_at(1, 1, "Profiling is off, start with --profile");
+        return;
+    }
+
+    // Print totals and wasted retries
+    uint64_t total = profile->instructions ? profile->instructions : 1;
+    printf_at(1, 1, "Instructions: %llu", (unsigned long long)profile->instructions);
+    printf_at(2, 1, "Frames: %llu", (unsigned long long)profile->frames);
+    printf_at(3, 1, "DXYN Waits: %5.1f%%", 100.0 * profile->dxyn_waits / total);
+    printf_at(4, 1, "FX0A Waits: %5.1f%%", 100.0 * profile->fx0a_waits / total);
+    printf_at(5, 1, "Idle Slots: %5.1f%%", 100.0 * profile->idle / (total + profile->idle));
+
+    // Print retired instructions per frame
+    uint32_t min, max;
+    double average;
+    get_profile_frame_stats(profile, &min, &max, &average);
+    printf_at(6, 1, "Retired/Frame: %.1f", average);
+    printf_at(7, 1, "  Min: %u Max: %u", min, max);
+
+    // Print shares of the most executed ops
+    printf_at(1, 35, "Ops:");
+    for (int op = 0, row = 2; op < OP_COUNT; op++) {
+        if (profile->op_counts[op] * 100 >= total && row < DEBUGGER_ROWS + 2) {
+            printf_at(row++, 35, "%-7s %5.1f%%", OP_NAMES[op], 100.0 * profile->op_counts[op] / total);
+        }
+    }
 
-    // Move to new row
-    printf_at(DEBUGGER_ROWS + 2, 1, "");
+    // Print hottest addresses
+    uint16_t addresses[PROFILE_TOP_ADDRESSES];
+    int count = get_profile_top_addresses(profile, addresses, PROFILE_TOP_ADDRESSES);
+    printf_at(9, 1, "Hottest Addresses:");
+    for (int i = 0; i < count; i++) {
+        printf_at(i + 10, 1, "0x%03X %5.1f%%", addresses[i], 100.0 * profile->address_counts[addresses[i]] / total);
+    }
 }
 
 void debug_update(chip8_t* chip8) {
-    // Clear the screen
-    printf("\033[2J");
+    // Refresh at a fixed rate, drawing every emulated frame would flood the terminal
+    uint64_t now = SDL_GetTicksNS();
+    if (now < next_refresh_ns) {
+        return;
+    }
+    next_refresh_ns = now + SCREEN_REFRESH_NS;
 
+    memset(screen, ' ', sizeof(screen));
     switch (mode) {
         case OVERVIEW:
             debug_overview(chip8);
@@ -84,23 +248,25 @@ void debug_update(chip8_t* chip8) {
         case MEMORY_DUMP:
             debug_memory_dump(chip8, page);
             break;
+        case PROFILE:
+            debug_profile(chip8);
+            break;
     }
-
-    // Flush output
-    fflush(stdout);
+    flush_screen();
 }
 
-void debug_handle_key_event(SDL_Event* event, chip8_t* cpu) {
-    bool is_key_down = event->type == SDL_EVENT_KEY_DOWN;
+// Handles a pressed key, called from the thread that runs `debug_update`
+void debug_handle_key(SDL_Scancode scancode) {
+    next_refresh_ns = 0;  // Show the effect of the key right away
 
-    if (is_key_down && event->key.scancode == SDL_SCANCODE_M) {
+    if (scancode == SDL_SCANCODE_M) {
         mode = (mode + 1) % DEBUGGER_MODE_COUNT;
     }
 
-    if (is_key_down && mode == MEMORY_DUMP && event->key.scancode == SDL_SCANCODE_COMMA) {
+    if (mode == MEMORY_DUMP && scancode == SDL_SCANCODE_COMMA) {
         page = (page - 1 + DEBUGGER_PAGE_COUNT) % DEBUGGER_PAGE_COUNT;
     }
-    if (is_key_down && mode == MEMORY_DUMP && event->key.scancode == SDL_SCANCODE_PERIOD) {
+    if (mode == MEMORY_DUMP && scancode == SDL_SCANCODE_PERIOD) {
         page = (page + 1) % DEBUGGER_PAGE_COUNT;
     }
 }
@@ -0,0 +1,105 @@
+#include "idle.h"
+
+#include <string.h>
+
+#include "chip8.h"
+#include "instructions.h"
+
+// Ops that read only registers, timers and keys and write only registers, none of these change
+// between two runs, so a loop of them repeats itself exactly until the next timer tick or key event
+static const bool IS_IDLE_OP[OP_COUNT] = {
+    [OP_1NNN] = true,
+    [OP_3XNN] = true,
+    [OP_4XNN] = true,
+    [OP_5XY0] = true,
+    [OP_6XNN] = true,
+    [OP_7XNN] = true,
+    [OP_8XY0] = true,
+    [OP_8XY1] = true,
+    [OP_8XY2] = true,
+    [OP_8XY3] = true,
+    [OP_8XY4] = true,
+    [OP_8XY5] = true,
+    [OP_8XY6] = true,
+    [OP_8XY7] = true,
+    [OP_8XYE] = true,
+    [OP_9XY0] = true,
+    [OP_ANNN] = true,
+    [OP_EX9E] = true,
+    [OP_EXA1] = true,
+    [OP_FX07] = true,
+    [OP_FX29] = true,
+};
+
+// Whether the program counter is inside a short loop of idle ops, closed by a jump back to or before it
+static bool is_in_idle_loop(chip8_t* cpu) {
+    uint16_t pc = cpu->pc;
+    for (int i = 0; i < IDLE_LOOP_MAX_LENGTH; i++) {
+        uint16_t address = pc + i * 2;
+        if (address > MEMORY_SIZE - 2) {
+            return false;
+        }
+
+        const instruction_t* instruction = fetch_instruction(cpu, address);
+        if (!IS_IDLE_OP[instruction->op]) {
+            return false;
+        }
+        if (instruction->op != OP_1NNN || instruction->nnn > pc) {
+            continue;  // Jumps forward may leave the loop
+        }
+
+        if (address - instruction->nnn >= IDLE_LOOP_MAX_LENGTH * 2) {
+            return false;
+        }
+        for (uint16_t start = instruction->nnn; start < pc; start += 2) {
+            if (!IS_IDLE_OP[fetch_instruction(cpu, start)->op]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+// Runs a delay timer or key polling loop at the program counter, skipping every iteration that would
+// only repeat the previous one, returns the instruction slots accounted for, 0 when there is no such loop,
+// and sets `retired` to the instructions actually run, which leaves out the skipped iterations
+int skip_idle_loop(chip8_t* cpu, int budget, int* retired) {
+    *retired = 0;
+    if (!is_in_idle_loop(cpu)) {
+        return 0;
+    }
+
+    // The first iteration may still change registers, e.g. VX = DT after a timer tick, the second can't
+    int executed = 0;
+    for (int iteration = 0; iteration < 2; iteration++) {
+        uint16_t start = cpu->pc;
+        uint16_t i = cpu->i;
+        uint8_t v[REGISTERS_COUNT];
+        memcpy(v, cpu->v, sizeof(v));
+
+        // Follow the actual path, which may leave the loop through a skip or a jump
+        int length = 0;
+        do {
+            if (executed == budget || length == IDLE_LOOP_MAX_LENGTH || !IS_IDLE_OP[fetch_instruction(cpu, cpu->pc)->op]) {
+                return executed;
+            }
+            step_chip8(cpu);
+            executed++;
+            (*retired)++;
+            length++;
+        } while (cpu->pc != start);
+
+        // Back at the start with the same registers, every further iteration is identical
+        if (cpu->i == i && memcmp(cpu->v, v, sizeof(v)) == 0) {
+            executed += (budget - executed) / length * length;
+            while (executed < budget) {
+                step_chip8(cpu);
+                executed++;
+                (*retired)++;
+            }
+            return executed;
+        }
+    }
+    return executed;
+}
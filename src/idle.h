@@ -0,0 +1,7 @@
+#pragma once
+
+#include "chip8_t.h"
+
+#define IDLE_LOOP_MAX_LENGTH 8  // Longest loop iteration, in instructions, that is looked for
+
+int skip_idle_loop(chip8_t* cpu, int budget, int* retired);
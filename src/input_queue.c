@@ -0,0 +1,27 @@
+#include "input_queue.h"
+
+void input_queue_init(input_queue_t* queue) {
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+}
+
+// Fails when the queue is full, the consumer fell behind by `INPUT_QUEUE_SIZE` events
+bool input_queue_push(input_queue_t* queue, input_event_t event) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == INPUT_QUEUE_SIZE) {
+        return false;
+    }
+    queue->events[tail % INPUT_QUEUE_SIZE] = event;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool input_queue_pop(input_queue_t* queue, input_event_t* event) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) {
+        return false;
+    }
+    *event = queue->events[head % INPUT_QUEUE_SIZE];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
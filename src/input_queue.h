@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define INPUT_QUEUE_SIZE 256  // Power of two, so the indices can wrap freely
+
+// Meaning of `type` and `value` is up to the caller
+typedef struct {
+    uint16_t type;
+    uint16_t value;
+} input_event_t;
+
+// Lock-free queue from one producer thread to one consumer thread
+typedef struct {
+    input_event_t events[INPUT_QUEUE_SIZE];
+    alignas(64) atomic_size_t head;  // Next event to pop, written by the consumer
+    alignas(64) atomic_size_t tail;  // Next slot to push to, written by the producer
+} input_queue_t;
+
+void input_queue_init(input_queue_t* queue);
+bool input_queue_push(input_queue_t* queue, input_event_t event);
+bool input_queue_pop(input_queue_t* queue, input_event_t* event);
@@ -1,377 +1,822 @@
 #include "instructions.h"
 
-#include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
-static const OpFuncPtr NIBLE_TABLE[16] = {
-    NULL, op_1NNN, op_2NNN, op_3XNN,
-    op_4XNN, op_5XY0, op_6XNN, op_7XNN,
-    NULL, op_9XY0, op_ANNN, op_BNNN,
-    op_CXNN, op_DXYN, NULL, NULL};
-
-OpFuncPtr get_instruction(uint16_t opcode) {
+#include "chip8.h"
+#include "quirks.h"
+
+// Handlers of the ops that behave the same in every quirk profile
+#define COMMON_HANDLERS        \
+    [OP_ILLEGAL] = op_ILLEGAL, \
+    [OP_00E0] = op_00E0,       \
+    [OP_00EE] = op_00EE,       \
+    [OP_1NNN] = op_1NNN,       \
+    [OP_2NNN] = op_2NNN,       \
+    [OP_3XNN] = op_3XNN,       \
+    [OP_4XNN] = op_4XNN,       \
+    [OP_5XY0] = op_5XY0,       \
+    [OP_6XNN] = op_6XNN,       \
+    [OP_7XNN] = op_7XNN,       \
+    [OP_8XY0] = op_8XY0,       \
+    [OP_8XY4] = op_8XY4,       \
+    [OP_8XY5] = op_8XY5,       \
+    [OP_8XY7] = op_8XY7,       \
+    [OP_9XY0] = op_9XY0,       \
+    [OP_ANNN] = op_ANNN,       \
+    [OP_CXNN] = op_CXNN,       \
+    [OP_EX9E] = op_EX9E,       \
+    [OP_EXA1] = op_EXA1,       \
+    [OP_FX07] = op_FX07,       \
+    [OP_FX0A] = op_FX0A,       \
+    [OP_FX15] = op_FX15,       \
+    [OP_FX18] = op_FX18,       \
+    [OP_FX1E] = op_FX1E,       \
+    [OP_FX29] = op_FX29,       \
+    [OP_FX33] = op_FX33,       \
+    [OP_F002] = op_F002,       \
+    [OP_FX3A] = op_FX3A,       \
+    [OP_00CN] = op_00CN,       \
+    [OP_00FB] = op_00FB,       \
+    [OP_00FC] = op_00FC,       \
+    [OP_00FE] = op_00FE,       \
+    [OP_00FF] = op_00FF,       \
+    [OP_FX30] = op_FX30,       \
+    [OP_FX75] = op_FX75,       \
+    [OP_FX85] = op_FX85,       \
+    [OP_00DN] = op_00DN,       \
+    [OP_F000] = op_F000,       \
+    [OP_5XY2] = op_5XY2,       \
+    [OP_5XY3] = op_5XY3,       \
+    [OP_FN01] = op_FN01
+
+const char* const OP_NAMES[OP_COUNT] = {
+    [OP_ILLEGAL] = "ILLEGAL",
+    [OP_00E0] = "00E0",
+    [OP_00EE] = "00EE",
+    [OP_1NNN] = "1NNN",
+    [OP_2NNN] = "2NNN",
+    [OP_3XNN] = "3XNN",
+    [OP_4XNN] = "4XNN",
+    [OP_5XY0] = "5XY0",
+    [OP_6XNN] = "6XNN",
+    [OP_7XNN] = "7XNN",
+    [OP_8XY0] = "8XY0",
+    [OP_8XY1] = "8XY1",
+    [OP_8XY2] = "8XY2",
+    [OP_8XY3] = "8XY3",
+    [OP_8XY4] = "8XY4",
+    [OP_8XY5] = "8XY5",
+    [OP_8XY6] = "8XY6",
+    [OP_8XY7] = "8XY7",
+    [OP_8XYE] = "8XYE",
+    [OP_9XY0] = "9XY0",
+    [OP_ANNN] = "ANNN",
+    [OP_BNNN] = "BNNN",
+    [OP_CXNN] = "CXNN",
+    [OP_DXYN] = "DXYN",
+    [OP_EX9E] = "EX9E",
+    [OP_EXA1] = "EXA1",
+    [OP_FX07] = "FX07",
+    [OP_FX0A] = "FX0A",
+    [OP_FX15] = "FX15",
+    [OP_FX18] = "FX18",
+    [OP_FX1E] = "FX1E",
+    [OP_FX29] = "FX29",
+    [OP_FX33] = "FX33",
+    [OP_FX55] = "FX55",
+    [OP_FX65] = "FX65",
+    [OP_F002] = "F002",
+    [OP_FX3A] = "FX3A",
+    [OP_00CN] = "00CN",
+    [OP_00FB] = "00FB",
+    [OP_00FC] = "00FC",
+    [OP_00FE] = "00FE",
+    [OP_00FF] = "00FF",
+    [OP_FX30] = "FX30",
+    [OP_FX75] = "FX75",
+    [OP_FX85] = "FX85",
+    [OP_00DN] = "00DN",
+    [OP_F000] = "F000",
+    [OP_5XY2] = "5XY2",
+    [OP_5XY3] = "5XY3",
+    [OP_FN01] = "FN01",
+};
+
+static const uint8_t NIBLE_TABLE[16] = {
+    OP_ILLEGAL, OP_1NNN, OP_2NNN, OP_3XNN,
+    OP_4XNN, OP_5XY0, OP_6XNN, OP_7XNN,
+    OP_ILLEGAL, OP_9XY0, OP_ANNN, OP_BNNN,
+    OP_CXNN, OP_DXYN, OP_ILLEGAL, OP_ILLEGAL};
+
+uint8_t INSTRUCTION_TABLE[INSTRUCTION_TABLE_SIZE];
+
+static op_t match_instruction(uint16_t opcode) {
     uint8_t nibble = (opcode & 0xF000) >> 12;
 
     if (nibble == 0x0) {
         switch (opcode & 0x00FF) {
             case 0x00E0:
-                return op_00E0;
+                return OP_00E0;
             case 0x00EE:
-                return op_00EE;
+                return OP_00EE;
+            case 0x00FB:
+                return OP_00FB;
+            case 0x00FC:
+                return OP_00FC;
+            case 0x00FE:
+                return OP_00FE;
+            case 0x00FF:
+                return OP_00FF;
+        }
+        if ((opcode & 0x00F0) == 0x00C0) {
+            return OP_00CN;
+        }
+        if ((opcode & 0x00F0) == 0x00D0) {
+            return OP_00DN;
+        }
+    }
+
+    if (nibble == 0x5) {
+        switch (opcode & 0x000F) {
+            case 0x2:
+                return OP_5XY2;
+            case 0x3:
+                return OP_5XY3;
         }
     }
 
     if (nibble == 0x8) {
         switch (opcode & 0x000F) {
             case 0x0:
-                return op_8XY0;
+                return OP_8XY0;
             case 0x1:
-                return op_8XY1;
+                return OP_8XY1;
             case 0x2:
-                return op_8XY2;
+                return OP_8XY2;
             case 0x3:
-                return op_8XY3;
+                return OP_8XY3;
             case 0x4:
-                return op_8XY4;
+                return OP_8XY4;
             case 0x5:
-                return op_8XY5;
+                return OP_8XY5;
             case 0x6:
-                return op_8XY6;
+                return OP_8XY6;
             case 0x7:
-                return op_8XY7;
+                return OP_8XY7;
             case 0xE:
-                return op_8XYE;
+                return OP_8XYE;
         }
     }
 
     if (nibble == 0xE) {
         switch (opcode & 0x00FF) {
             case 0x9E:
-                return op_EX9E;
+                return OP_EX9E;
             case 0xA1:
-                return op_EXA1;
+                return OP_EXA1;
         }
     }
 
+    if (opcode == 0xF000) {
+        return OP_F000;
+    }
+    if (opcode == 0xF002) {
+        return OP_F002;
+    }
+
     if (nibble == 0xF) {
         switch (opcode & 0x00FF) {
+            case 0x01:
+                return OP_FN01;
             case 0x07:
-                return op_FX07;
+                return OP_FX07;
             case 0x0A:
-                return op_FX0A;
+                return OP_FX0A;
             case 0x15:
-                return op_FX15;
+                return OP_FX15;
             case 0x18:
-                return op_FX18;
+                return OP_FX18;
             case 0x1E:
-                return op_FX1E;
+                return OP_FX1E;
             case 0x29:
-                return op_FX29;
+                return OP_FX29;
+            case 0x30:
+                return OP_FX30;
             case 0x33:
-                return op_FX33;
+                return OP_FX33;
+            case 0x3A:
+                return OP_FX3A;
             case 0x55:
-                return op_FX55;
+                return OP_FX55;
             case 0x65:
-                return op_FX65;
+                return OP_FX65;
+            case 0x75:
+                return OP_FX75;
+            case 0x85:
+                return OP_FX85;
         }
     }
 
     return NIBLE_TABLE[nibble];
 }
 
-void op_00E0(chip8_t* cpu, uint16_t opcode) {
-    memset(cpu->display, 0, DISPLAY_WIDTH * DISPLAY_HEIGHT);
+void init_instructions(void) {
+    static bool is_initialized = false;
+    if (is_initialized) {
+        return;
+    }
+
+    // Decode every possible opcode once, so dispatch is a single table lookup
+    for (uint32_t opcode = 0; opcode < INSTRUCTION_TABLE_SIZE; opcode++) {
+        INSTRUCTION_TABLE[opcode] = match_instruction(opcode);
+    }
+    is_initialized = true;
+}
+
+instruction_t decode_instruction(uint16_t opcode, quirks_t quirks) {
+    return (instruction_t){
+        .handler = get_instruction(opcode, quirks),
+        .op = INSTRUCTION_TABLE[opcode],
+        .opcode = opcode,
+        .nnn = opcode & 0x0FFF,
+        .x = (opcode & 0x0F00) >> 8,
+        .y = (opcode & 0x00F0) >> 4,
+        .n = opcode & 0x000F,
+        .nn = opcode & 0x00FF,
+        .skip = 2,
+    };
+}
+
+void op_ILLEGAL(chip8_t* cpu, const instruction_t* instruction) {
+    // Treated as a no-op, but recorded so frontends can report it
+    cpu->is_illegal = true;
+    cpu->illegal_opcode = instruction->opcode;
+}
+
+// Whether FN01 selected the plane, only selected planes are drawn, cleared and scrolled
+static inline bool is_plane_selected(const chip8_t* cpu, int plane) {
+    return cpu->planes & (1 << plane);
+}
+
+void op_00E0(chip8_t* cpu, const instruction_t* instruction) {
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (is_plane_selected(cpu, plane)) {
+            memset(cpu->display[plane], 0, sizeof(cpu->display[plane]));
+        }
+    }
+    cpu->is_redraw_needed = true;
+    cpu->dirty_rows = DISPLAY_ALL_ROWS;
+}
+
+void op_00CN(chip8_t* cpu, const instruction_t* instruction) {
+    int rows = instruction->n;
+    int height = get_display_height(cpu);
+
+    // Move whole rows down, the rows scrolled in at the top are blank
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (is_plane_selected(cpu, plane)) {
+            uint64_t(*display)[DISPLAY_WORDS] = cpu->display[plane];
+            memmove(display[rows], display[0], (height - rows) * sizeof(display[0]));
+            memset(display[0], 0, rows * sizeof(display[0]));
+        }
+    }
+    cpu->is_redraw_needed = true;
+    cpu->dirty_rows = DISPLAY_ALL_ROWS;
+}
+
+void op_00DN(chip8_t* cpu, const instruction_t* instruction) {
+    int rows = instruction->n;
+    int height = get_display_height(cpu);
+
+    // Move whole rows up, the rows scrolled in at the bottom are blank
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (is_plane_selected(cpu, plane)) {
+            uint64_t(*display)[DISPLAY_WORDS] = cpu->display[plane];
+            memmove(display[0], display[rows], (height - rows) * sizeof(display[0]));
+            memset(display[height - rows], 0, rows * sizeof(display[0]));
+        }
+    }
+    cpu->is_redraw_needed = true;
+    cpu->dirty_rows = DISPLAY_ALL_ROWS;
+}
+
+void op_00FB(chip8_t* cpu, const instruction_t* instruction) {
+    // Shift every row right by 4 pixels, carrying the pixels that leave a word into the next one
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!is_plane_selected(cpu, plane)) {
+            continue;
+        }
+        if (cpu->is_hires) {
+            for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+                uint64_t* row = cpu->display[plane][y];
+                row[1] = (row[1] >> 4) | (row[0] << 60);
+                row[0] >>= 4;
+            }
+        } else {
+            for (int y = 0; y < LORES_HEIGHT; y++) {
+                cpu->display[plane][y][0] >>= 4;
+            }
+        }
+    }
+    cpu->is_redraw_needed = true;
+    cpu->dirty_rows = DISPLAY_ALL_ROWS;
+}
+
+void op_00FC(chip8_t* cpu, const instruction_t* instruction) {
+    // Shift every row left by 4 pixels, carrying the pixels that leave a word into the previous one
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!is_plane_selected(cpu, plane)) {
+            continue;
+        }
+        if (cpu->is_hires) {
+            for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+                uint64_t* row = cpu->display[plane][y];
+                row[0] = (row[0] << 4) | (row[1] >> 60);
+                row[1] <<= 4;
+            }
+        } else {
+            for (int y = 0; y < LORES_HEIGHT; y++) {
+                cpu->display[plane][y][0] <<= 4;
+            }
+        }
+    }
+    cpu->is_redraw_needed = true;
+    cpu->dirty_rows = DISPLAY_ALL_ROWS;
+}
+
+void op_00FE(chip8_t* cpu, const instruction_t* instruction) {
+    // Switching modes clears every plane, as in Octo
+    cpu->is_hires = false;
+    memset(cpu->display, 0, sizeof(cpu->display));
+    cpu->is_redraw_needed = true;
+    cpu->dirty_rows = DISPLAY_ALL_ROWS;
+}
+
+void op_00FF(chip8_t* cpu, const instruction_t* instruction) {
+    cpu->is_hires = true;
+    memset(cpu->display, 0, sizeof(cpu->display));
     cpu->is_redraw_needed = true;
+    cpu->dirty_rows = DISPLAY_ALL_ROWS;
 }
 
-void op_00EE(chip8_t* cpu, uint16_t opcode) {
+void op_00EE(chip8_t* cpu, const instruction_t* instruction) {
     cpu->sp--;
-    cpu->pc = cpu->stack[cpu->sp];
+    cpu->pc = cpu->stack[cpu->sp % STACK_SIZE];
 }
 
-void op_1NNN(chip8_t* cpu, uint16_t opcode) {
-    uint16_t address = opcode & 0x0FFF;
+void op_1NNN(chip8_t* cpu, const instruction_t* instruction) {
+    uint16_t address = instruction->nnn;
 
     cpu->pc = address;
 }
 
-void op_2NNN(chip8_t* cpu, uint16_t opcode) {
-    uint16_t address = opcode & 0x0FFF;
+void op_2NNN(chip8_t* cpu, const instruction_t* instruction) {
+    uint16_t address = instruction->nnn;
 
-    cpu->stack[cpu->sp] = cpu->pc;
+    cpu->stack[cpu->sp % STACK_SIZE] = cpu->pc;  // Wrap around on overflow instead of writing past the stack
     cpu->sp++;
     cpu->pc = address;
 }
 
-void op_3XNN(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t value = opcode & 0x00FF;
+void op_3XNN(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t value = instruction->nn;
 
     if (cpu->v[vx] == value) {
-        cpu->pc += 2;
+        cpu->pc += instruction->skip;
     }
 }
 
-void op_4XNN(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t value = opcode & 0x00FF;
+void op_4XNN(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t value = instruction->nn;
 
     if (cpu->v[vx] != value) {
-        cpu->pc += 2;
+        cpu->pc += instruction->skip;
     }
 }
 
-void op_5XY0(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+void op_5XY0(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
     if (cpu->v[vx] == cpu->v[vy]) {
-        cpu->pc += 2;
+        cpu->pc += instruction->skip;
     }
 }
 
-void op_6XNN(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t value = opcode & 0x00FF;
+void op_6XNN(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t value = instruction->nn;
 
     cpu->v[vx] = value;
 }
 
-void op_7XNN(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t value = opcode & 0x00FF;
+void op_7XNN(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t value = instruction->nn;
 
     cpu->v[vx] += value;
 }
 
-void op_8XY0(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+void op_8XY0(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
     cpu->v[vx] = cpu->v[vy];
 }
 
-void op_8XY1(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+void op_8XY4(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
-    cpu->v[vx] |= cpu->v[vy];
-    cpu->v[0xF] = 0;  // Quirk, refer to https://github.com/Timendus/chip8-test-suite?tab=readme-ov-file#the-test
+    uint16_t sum = cpu->v[vx] + cpu->v[vy];
+    cpu->v[vx] = sum & 0xFF;
+    cpu->v[0xF] = sum > 0xFF;
 }
 
-void op_8XY2(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+void op_8XY5(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
-    cpu->v[vx] &= cpu->v[vy];
-    cpu->v[0xF] = 0;  // Quirk, refer to https://github.com/Timendus/chip8-test-suite?tab=readme-ov-file#the-test
+    int8_t sub = cpu->v[vx] - cpu->v[vy];
+    cpu->v[vx] = sub;
+    cpu->v[0xF] = sub >= 0;
 }
 
-void op_8XY3(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+void op_8XY7(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
-    cpu->v[vx] ^= cpu->v[vy];
-    cpu->v[0xF] = 0;  // Quirk, refer to https://github.com/Timendus/chip8-test-suite?tab=readme-ov-file#the-test
+    int8_t sub = cpu->v[vy] - cpu->v[vx];
+    cpu->v[vx] = sub;
+    cpu->v[0xF] = sub >= 0;
 }
 
-void op_8XY4(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+void op_9XY0(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
-    uint16_t sum = cpu->v[vx] + cpu->v[vy];
-    cpu->v[vx] = sum & 0xFF;
-    cpu->v[0xF] = sum > 0xFF;
+    if (cpu->v[vx] != cpu->v[vy]) {
+        cpu->pc += instruction->skip;
+    }
 }
 
-void op_8XY5(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+void op_ANNN(chip8_t* cpu, const instruction_t* instruction) {
+    uint16_t address = instruction->nnn;
 
-    int8_t sub = cpu->v[vx] - cpu->v[vy];
-    cpu->v[vx] = sub;
-    cpu->v[0xF] = sub >= 0;
+    cpu->i = address;
 }
 
-void op_8XY6(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+void op_CXNN(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t value = instruction->nn;
 
-    uint8_t y = cpu->v[vy];
-    cpu->v[vx] = y >> 1;
-    cpu->v[0xF] = y & 0x1;
+    cpu->v[vx] = next_chip8_random(cpu) & value;
 }
 
-void op_8XY7(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+// Only the low nibble of VX names a key, as on the VIP
+void op_EX9E(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
 
-    int8_t sub = cpu->v[vy] - cpu->v[vx];
-    cpu->v[vx] = sub;
-    cpu->v[0xF] = sub >= 0;
+    if (cpu->keyboard[cpu->v[vx] & (KEYBOARD_SIZE - 1)]) {
+        cpu->pc += instruction->skip;
+    }
 }
 
-void op_8XYE(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+void op_EXA1(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
 
-    uint8_t y = cpu->v[vy];
-    cpu->v[vx] = y << 1;
-    cpu->v[0xF] = (y & 0x80) ? 1 : 0;
+    if (!cpu->keyboard[cpu->v[vx] & (KEYBOARD_SIZE - 1)]) {
+        cpu->pc += instruction->skip;
+    }
 }
 
-void op_9XY0(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
+void op_FX07(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
 
-    if (cpu->v[vx] != cpu->v[vy]) {
-        cpu->pc += 2;
+    cpu->v[vx] = cpu->delay_timer;
+}
+
+void op_FX0A(chip8_t* cpu, const instruction_t* instruction) {
+    // Wait for a key to be pressed and then released, as on the COSMAC VIP,
+    // `wake_chip8` stores the key in VX once released
+    cpu->wait_state = WAIT_KEY_PRESS;
+    for (int i = 0; i < KEYBOARD_SIZE; i++) {
+        if (cpu->keyboard[i]) {
+            cpu->wait_key = i;
+            cpu->wait_state = WAIT_KEY_RELEASE;
+            break;
+        }
     }
+    cpu->pc -= 2;  // Stay on this instruction while waiting
 }
 
-void op_ANNN(chip8_t* cpu, uint16_t opcode) {
-    uint16_t address = opcode & 0x0FFF;
+void op_FX15(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
 
-    cpu->i = address;
+    cpu->delay_timer = cpu->v[vx];
 }
 
-void op_BNNN(chip8_t* cpu, uint16_t opcode) {
-    uint16_t address = opcode & 0x0FFF;
+void op_FX18(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
 
-    cpu->pc = cpu->v[0] + address;
+    cpu->sound_timer = cpu->v[vx];
 }
 
-void op_CXNN(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t value = opcode & 0x00FF;
+void op_FX1E(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
 
-    srand(time(NULL));
-    uint8_t rand_byte = rand() % 256;
-    cpu->v[vx] = rand_byte & value;
+    cpu->i += cpu->v[vx];
 }
 
-void op_DXYN(chip8_t* cpu, uint16_t opcode) {
-    // Don't draw if we're waiting for a redraw
-    // Quirk, refer to https://github.com/Timendus/chip8-test-suite?tab=readme-ov-file#the-test
-    if (cpu->is_redraw_needed) {
-        cpu->pc -= 2;  // Stay on this instruction
-        return;
+void op_FX29(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+
+    cpu->i = FONTSET_START_ADDR + (cpu->v[vx] * 5);
+}
+
+void op_FX33(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+
+    cpu->memory[cpu->i] = cpu->v[vx] / 100;
+    cpu->memory[(uint16_t)(cpu->i + 1)] = (cpu->v[vx] / 10) % 10;
+    cpu->memory[(uint16_t)(cpu->i + 2)] = cpu->v[vx] % 10;
+    invalidate_chip8_cache(cpu, cpu->i, 3);  // The ROM may be writing over its own code
+}
+
+void op_F002(chip8_t* cpu, const instruction_t* instruction) {
+    for (int i = 0; i < AUDIO_PATTERN_SIZE; i++) {
+        cpu->audio_pattern[i] = cpu->memory[(cpu->i + i) & (MEMORY_SIZE - 1)];
     }
+    cpu->is_audio_pattern = true;
+}
 
-    uint8_t vx = (opcode & 0x0F00) >> 8;
-    uint8_t vy = (opcode & 0x00F0) >> 4;
-    uint8_t height = opcode & 0x000F;
+void op_FX3A(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
 
-    uint8_t init_x = cpu->v[vx] % DISPLAY_WIDTH;
-    uint8_t init_y = cpu->v[vy] % DISPLAY_HEIGHT;
+    cpu->audio_pitch = cpu->v[vx];
+}
 
-    cpu->v[0xF] = 0;
-    for (int row = 0; row < height; row++) {
-        uint8_t* sprite_row = &cpu->memory[cpu->i + row];
-        for (int col = 0; col < 8; col++) {
-            if (!(*sprite_row & (0x80 >> col))) {
-                continue;  // Skip if pixel is not set
-            }
+void op_FX30(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
 
-            int x = init_x + col;
-            int y = init_y + row;
+    cpu->i = BIG_FONTSET_START_ADDR + (cpu->v[vx] & 0xF) * 10;
+}
 
-            if (x >= DISPLAY_WIDTH || y >= DISPLAY_HEIGHT) {
-                continue;  // Clip sprites at screen boundaries, instead of wrapping
-                           // Quirk, refer to https://github.com/Timendus/chip8-test-suite?tab=readme-ov-file#the-test
-            }
+void op_FX75(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
 
-            if (cpu->display[y * DISPLAY_WIDTH + x]) {
-                cpu->v[0xF] = 1;  // Set collision flag if pixel is already set
-            }
+    memcpy(cpu->rpl_flags, cpu->v, vx + 1);
+}
 
-            cpu->display[y * DISPLAY_WIDTH + x] ^= true;
-        }
+void op_FX85(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+
+    memcpy(cpu->v, cpu->rpl_flags, vx + 1);
+}
+
+void op_F000(chip8_t* cpu, const instruction_t* instruction) {
+    // The address is the second word, decoded into `nnn` along with the opcode
+    cpu->i = instruction->nnn;
+    cpu->pc += 2;
+}
+
+void op_5XY2(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
+
+    // Registers VX to VY, in descending order if X is above Y, I is left as is
+    int step = vx <= vy ? 1 : -1;
+    int count = (vx <= vy ? vy - vx : vx - vy) + 1;
+    for (int i = 0; i < count; i++) {
+        cpu->memory[(uint16_t)(cpu->i + i)] = cpu->v[vx + i * step];
     }
-    cpu->is_redraw_needed = true;
+    invalidate_chip8_cache(cpu, cpu->i, count);  // The ROM may be writing over its own code
 }
 
-void op_EX9E(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+void op_5XY3(chip8_t* cpu, const instruction_t* instruction) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
-    if (cpu->keyboard[cpu->v[vx]]) {
-        cpu->pc += 2;
+    int step = vx <= vy ? 1 : -1;
+    int count = (vx <= vy ? vy - vx : vx - vy) + 1;
+    for (int i = 0; i < count; i++) {
+        cpu->v[vx + i * step] = cpu->memory[(uint16_t)(cpu->i + i)];
     }
 }
 
-void op_EXA1(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+void op_FN01(chip8_t* cpu, const instruction_t* instruction) {
+    cpu->planes = instruction->x & ((1 << DISPLAY_PLANES) - 1);
+}
+
+// Ops that differ between quirk profiles, written once with the quirks as parameters, `DEFINE_QUIRK_HANDLERS`
+// specializes them per profile with constant quirks, so none of them branches on the profile at runtime
+
+static ALWAYS_INLINE void op_8XY1_quirks(chip8_t* cpu, const instruction_t* instruction, bool is_vf_reset) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
-    if (!cpu->keyboard[cpu->v[vx]]) {
-        cpu->pc += 2;
+    cpu->v[vx] |= cpu->v[vy];
+    if (is_vf_reset) {
+        cpu->v[0xF] = 0;
     }
 }
 
-void op_FX07(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+static ALWAYS_INLINE void op_8XY2_quirks(chip8_t* cpu, const instruction_t* instruction, bool is_vf_reset) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
-    cpu->v[vx] = cpu->delay_timer;
+    cpu->v[vx] &= cpu->v[vy];
+    if (is_vf_reset) {
+        cpu->v[0xF] = 0;
+    }
 }
 
-void op_FX0A(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+static ALWAYS_INLINE void op_8XY3_quirks(chip8_t* cpu, const instruction_t* instruction, bool is_vf_reset) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
-    for (int i = 0; i < 16; i++) {
-        if (cpu->keyboard[i]) {
-            cpu->v[vx] = i;
-            return;
-        }
+    cpu->v[vx] ^= cpu->v[vy];
+    if (is_vf_reset) {
+        cpu->v[0xF] = 0;
     }
-    cpu->pc -= 2;  // Revert program counter if no key is pressed
 }
 
-void op_FX15(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+static ALWAYS_INLINE void op_8XY6_quirks(chip8_t* cpu, const instruction_t* instruction, bool is_shift_vy) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
-    cpu->delay_timer = cpu->v[vx];
+    uint8_t value = cpu->v[is_shift_vy ? vy : vx];
+    cpu->v[vx] = value >> 1;
+    cpu->v[0xF] = value & 0x1;
 }
 
-void op_FX18(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+static ALWAYS_INLINE void op_8XYE_quirks(chip8_t* cpu, const instruction_t* instruction, bool is_shift_vy) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
 
-    cpu->sound_timer = cpu->v[vx];
+    uint8_t value = cpu->v[is_shift_vy ? vy : vx];
+    cpu->v[vx] = value << 1;
+    cpu->v[0xF] = (value & 0x80) ? 1 : 0;
 }
 
-void op_FX1E(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+static ALWAYS_INLINE void op_BNNN_quirks(chip8_t* cpu, const instruction_t* instruction, bool is_jump_vx) {
+    uint16_t address = instruction->nnn;
 
-    cpu->i += cpu->v[vx];
+    cpu->pc = cpu->v[is_jump_vx ? instruction->x : 0] + address;
 }
 
-void op_FX29(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+// XOR one sprite row, leftmost pixel in the MSB, into a display row of `width` pixels at `x`,
+// returns whether a set pixel was erased
+static ALWAYS_INLINE bool draw_sprite_row(uint64_t* display_row, int width, int x, uint64_t sprite, bool is_clipped) {
+    int word = x / 64;
+    int shift = x % 64;
+    uint64_t collision = display_row[word] & (sprite >> shift);
+    display_row[word] ^= sprite >> shift;
 
-    cpu->i = FONTSET_START_ADDR + (cpu->v[vx] * 5);
+    // Sprites are at most 16 pixels wide, so the rest falls in the next word, past the right edge it's
+    // shifted out or rotated in on the left
+    if (shift) {
+        uint64_t rest = sprite << (64 - shift);
+        int next = word + 1;
+        if (next == width / 64) {
+            if (is_clipped) return collision;
+            next = 0;
+        }
+        collision |= display_row[next] & rest;
+        display_row[next] ^= rest;
+    }
+    return collision;
 }
 
-void op_FX33(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+// Draws the sprite of DXYN in a display of the given size, DXY0 draws a 16x16 sprite of two bytes per row
+// with the big sprite quirk, each selected plane draws its own sprite, stored one after the other from I
+static ALWAYS_INLINE void draw_sprite(chip8_t* cpu, const instruction_t* instruction, int width, int height,
+                                      bool is_clipped, bool is_big_sprite) {
+    uint8_t vx = instruction->x;
+    uint8_t vy = instruction->y;
+    bool is_big = is_big_sprite && instruction->n == 0;
+    int rows = is_big ? 16 : instruction->n;
+    int size = is_big ? 32 : rows;  // Bytes per plane
 
-    cpu->memory[cpu->i] = cpu->v[vx] / 100;
-    cpu->memory[cpu->i + 1] = (cpu->v[vx] / 10) % 10;
-    cpu->memory[cpu->i + 2] = cpu->v[vx] % 10;
+    int init_x = cpu->v[vx] % width;
+    int init_y = cpu->v[vy] % height;
+
+    // Clip sprites at the bottom edge, or wrap them to the top
+    if (is_clipped && rows > height - init_y) {
+        rows = height - init_y;
+    }
+
+    bool is_collision = false;
+    uint16_t address = cpu->i;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!is_plane_selected(cpu, plane)) {
+            continue;
+        }
+
+        for (int row = 0; row < rows; row++) {
+            uint64_t sprite;
+            if (is_big) {
+                uint16_t row_address = address + row * 2;
+                sprite = (uint64_t)cpu->memory[row_address] << 56 | (uint64_t)cpu->memory[(uint16_t)(row_address + 1)] << 48;
+            } else {
+                sprite = (uint64_t)cpu->memory[(uint16_t)(address + row)] << 56;
+            }
+
+            int y = (init_y + row) % height;
+            is_collision |= draw_sprite_row(cpu->display[plane][y], width, init_x, sprite, is_clipped);
+            cpu->dirty_rows |= (uint64_t)(sprite != 0) << y;  // Blank sprite rows leave the display as is
+        }
+        address += size;
+    }
+    cpu->v[0xF] = is_collision;  // Set collision flag if any pixel was already set
+}
+
+static ALWAYS_INLINE void op_DXYN_quirks(chip8_t* cpu, const instruction_t* instruction, bool is_clipped,
+                                         bool is_display_wait, bool is_big_sprite) {
+    // Don't draw if we're waiting for a redraw
+    if (is_display_wait && cpu->is_redraw_needed) {
+        cpu->wait_state = WAIT_VBLANK;
+        cpu->pc -= 2;  // Stay on this instruction
+        return;
+    }
+
+    if (cpu->is_hires) {
+        draw_sprite(cpu, instruction, DISPLAY_WIDTH, DISPLAY_HEIGHT, is_clipped, is_big_sprite);
+    } else {
+        draw_sprite(cpu, instruction, LORES_WIDTH, LORES_HEIGHT, is_clipped, is_big_sprite);
+    }
+    cpu->is_redraw_needed = true;
 }
 
-void op_FX55(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+static ALWAYS_INLINE void op_FX55_quirks(chip8_t* cpu, const instruction_t* instruction, memory_quirk_t memory) {
+    uint8_t vx = instruction->x;
 
     for (int i = 0; i <= vx; i++) {
-        cpu->memory[cpu->i + i] = cpu->v[i];
+        cpu->memory[(uint16_t)(cpu->i + i)] = cpu->v[i];
+    }
+    invalidate_chip8_cache(cpu, cpu->i, vx + 1);  // The ROM may be writing over its own code
+    if (memory != MEMORY_I_UNCHANGED) {
+        cpu->i += vx + (memory == MEMORY_I_PLUS_X_PLUS_1);
     }
-    cpu->i += vx + 1;  // Quirk, refer to https://github.com/Timendus/chip8-test-suite?tab=readme-ov-file#the-test
 }
 
-void op_FX65(chip8_t* cpu, uint16_t opcode) {
-    uint8_t vx = (opcode & 0x0F00) >> 8;
+static ALWAYS_INLINE void op_FX65_quirks(chip8_t* cpu, const instruction_t* instruction, memory_quirk_t memory) {
+    uint8_t vx = instruction->x;
 
     for (int i = 0; i <= vx; i++) {
-        cpu->v[i] = cpu->memory[cpu->i + i];
+        cpu->v[i] = cpu->memory[(uint16_t)(cpu->i + i)];
+    }
+    if (memory != MEMORY_I_UNCHANGED) {
+        cpu->i += vx + (memory == MEMORY_I_PLUS_X_PLUS_1);
     }
-    cpu->i += vx + 1;  // Quirk, refer to https://github.com/Timendus/chip8-test-suite?tab=readme-ov-file#the-test
 }
+
+// Handlers of one profile, and its table of every handler
+#define DEFINE_QUIRK_HANDLERS(id, name, vf_reset, memory, shift_vy, clipped, display_wait, jump_vx, big_sprite) \
+    static void op_8XY1_##id(chip8_t* cpu, const instruction_t* instruction) {                                  \
+        op_8XY1_quirks(cpu, instruction, vf_reset);                                                             \
+    }                                                                                                           \
+    static void op_8XY2_##id(chip8_t* cpu, const instruction_t* instruction) {                                  \
+        op_8XY2_quirks(cpu, instruction, vf_reset);                                                             \
+    }                                                                                                           \
+    static void op_8XY3_##id(chip8_t* cpu, const instruction_t* instruction) {                                  \
+        op_8XY3_quirks(cpu, instruction, vf_reset);                                                             \
+    }                                                                                                           \
+    static void op_8XY6_##id(chip8_t* cpu, const instruction_t* instruction) {                                  \
+        op_8XY6_quirks(cpu, instruction, shift_vy);                                                             \
+    }                                                                                                           \
+    static void op_8XYE_##id(chip8_t* cpu, const instruction_t* instruction) {                                  \
+        op_8XYE_quirks(cpu, instruction, shift_vy);                                                             \
+    }                                                                                                           \
+    static void op_BNNN_##id(chip8_t* cpu, const instruction_t* instruction) {                                  \
+        op_BNNN_quirks(cpu, instruction, jump_vx);                                                              \
+    }                                                                                                           \
+    static void op_DXYN_##id(chip8_t* cpu, const instruction_t* instruction) {                                  \
+        op_DXYN_quirks(cpu, instruction, clipped, display_wait, big_sprite);                                    \
+    }                                                                                                           \
+    static void op_FX55_##id(chip8_t* cpu, const instruction_t* instruction) {                                  \
+        op_FX55_quirks(cpu, instruction, memory);                                                               \
+    }                                                                                                           \
+    static void op_FX65_##id(chip8_t* cpu, const instruction_t* instruction) {                                  \
+        op_FX65_quirks(cpu, instruction, memory);                                                               \
+    }                                                                                                           \
+    static const OpFuncPtr id##_HANDLERS[OP_COUNT] = {                                                          \
+        COMMON_HANDLERS,                                                                                        \
+        [OP_8XY1] = op_8XY1_##id,                                                                               \
+        [OP_8XY2] = op_8XY2_##id,                                                                               \
+        [OP_8XY3] = op_8XY3_##id,                                                                               \
+        [OP_8XY6] = op_8XY6_##id,                                                                               \
+        [OP_8XYE] = op_8XYE_##id,                                                                               \
+        [OP_BNNN] = op_BNNN_##id,                                                                               \
+        [OP_DXYN] = op_DXYN_##id,                                                                               \
+        [OP_FX55] = op_FX55_##id,                                                                               \
+        [OP_FX65] = op_FX65_##id,                                                                               \
+    };
+
+FOR_EACH_QUIRK_PROFILE(DEFINE_QUIRK_HANDLERS)
+
+#define QUIRK_HANDLERS_ENTRY(id, ...) [QUIRKS_##id] = id##_HANDLERS,
+
+const OpFuncPtr* const QUIRK_HANDLERS[QUIRKS_COUNT] = {FOR_EACH_QUIRK_PROFILE(QUIRK_HANDLERS_ENTRY)};
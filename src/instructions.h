@@ -2,41 +2,115 @@
 
 #include "chip8_t.h"
 
-typedef void (*OpFuncPtr)(chip8_t*, uint16_t);
-
-OpFuncPtr get_instruction(uint16_t opcode);
-
-void op_00E0(chip8_t* cpu, uint16_t opcode);  // Clear Screen
-void op_00EE(chip8_t* cpu, uint16_t opcode);  // Return from Subroutine
-void op_1NNN(chip8_t* cpu, uint16_t opcode);  // Jump to Address
-void op_2NNN(chip8_t* cpu, uint16_t opcode);  // Call Subroutine
-void op_3XNN(chip8_t* cpu, uint16_t opcode);  // Skip if Equal
-void op_4XNN(chip8_t* cpu, uint16_t opcode);  // Skip if Not Equal
-void op_5XY0(chip8_t* cpu, uint16_t opcode);  // Skip if Registers Equal
-void op_6XNN(chip8_t* cpu, uint16_t opcode);  // Load Value into Register
-void op_7XNN(chip8_t* cpu, uint16_t opcode);  // Add Value to Register
-void op_8XY0(chip8_t* cpu, uint16_t opcode);  // Copy Register
-void op_8XY1(chip8_t* cpu, uint16_t opcode);  // OR Register
-void op_8XY2(chip8_t* cpu, uint16_t opcode);  // AND Register
-void op_8XY3(chip8_t* cpu, uint16_t opcode);  // XOR Register
-void op_8XY4(chip8_t* cpu, uint16_t opcode);  // Add Registers
-void op_8XY5(chip8_t* cpu, uint16_t opcode);  // Subtract Registers
-void op_8XY6(chip8_t* cpu, uint16_t opcode);  // Shift Right
-void op_8XY7(chip8_t* cpu, uint16_t opcode);  // Subtract Registers (Reverse)
-void op_8XYE(chip8_t* cpu, uint16_t opcode);  // Shift Left
-void op_9XY0(chip8_t* cpu, uint16_t opcode);  // Skip if Registers Not Equal
-void op_ANNN(chip8_t* cpu, uint16_t opcode);  // Load Address into I
-void op_BNNN(chip8_t* cpu, uint16_t opcode);  // Jump to Address + V0
-void op_CXNN(chip8_t* cpu, uint16_t opcode);  // Generate Random Number
-void op_DXYN(chip8_t* cpu, uint16_t opcode);  // Draw Sprite
-void op_EX9E(chip8_t* cpu, uint16_t opcode);  // Skip if Key Pressed
-void op_EXA1(chip8_t* cpu, uint16_t opcode);  // Skip if Key Not Pressed
-void op_FX07(chip8_t* cpu, uint16_t opcode);  // Load Delay Timer into Register
-void op_FX0A(chip8_t* cpu, uint16_t opcode);  // Wait for Key Press
-void op_FX15(chip8_t* cpu, uint16_t opcode);  // Set Delay Timer
-void op_FX18(chip8_t* cpu, uint16_t opcode);  // Set Sound Timer
-void op_FX1E(chip8_t* cpu, uint16_t opcode);  // Add to I
-void op_FX29(chip8_t* cpu, uint16_t opcode);  // Load Sprite Location
-void op_FX33(chip8_t* cpu, uint16_t opcode);  // Store BCD
-void op_FX55(chip8_t* cpu, uint16_t opcode);  // Store Registers
-void op_FX65(chip8_t* cpu, uint16_t opcode);  // Read Registers
+#define INSTRUCTION_TABLE_SIZE 0x10000
+
+typedef enum {
+    OP_ILLEGAL,
+    OP_00E0,
+    OP_00EE,
+    OP_1NNN,
+    OP_2NNN,
+    OP_3XNN,
+    OP_4XNN,
+    OP_5XY0,
+    OP_6XNN,
+    OP_7XNN,
+    OP_8XY0,
+    OP_8XY1,
+    OP_8XY2,
+    OP_8XY3,
+    OP_8XY4,
+    OP_8XY5,
+    OP_8XY6,
+    OP_8XY7,
+    OP_8XYE,
+    OP_9XY0,
+    OP_ANNN,
+    OP_BNNN,
+    OP_CXNN,
+    OP_DXYN,
+    OP_EX9E,
+    OP_EXA1,
+    OP_FX07,
+    OP_FX0A,
+    OP_FX15,
+    OP_FX18,
+    OP_FX1E,
+    OP_FX29,
+    OP_FX33,
+    OP_FX55,
+    OP_FX65,
+    OP_F002,
+    OP_FX3A,
+    OP_00CN,
+    OP_00FB,
+    OP_00FC,
+    OP_00FE,
+    OP_00FF,
+    OP_FX30,
+    OP_FX75,
+    OP_FX85,
+    OP_00DN,
+    OP_F000,
+    OP_5XY2,
+    OP_5XY3,
+    OP_FN01,
+    OP_COUNT
+} op_t;
+
+extern const OpFuncPtr* const QUIRK_HANDLERS[QUIRKS_COUNT];  // Handler for every op, one table per quirk profile
+extern const char* const OP_NAMES[OP_COUNT];                 // Printable name of every op
+extern uint8_t INSTRUCTION_TABLE[INSTRUCTION_TABLE_SIZE];  // Op for every opcode, filled by `init_instructions`
+
+void init_instructions(void);
+instruction_t decode_instruction(uint16_t opcode, quirks_t quirks);
+
+static inline OpFuncPtr get_instruction(uint16_t opcode, quirks_t quirks) {
+    return QUIRK_HANDLERS[quirks][INSTRUCTION_TABLE[opcode]];
+}
+
+void op_ILLEGAL(chip8_t* cpu, const instruction_t* instruction);  // Illegal Opcode
+
+void op_00E0(chip8_t* cpu, const instruction_t* instruction);  // Clear Screen
+void op_00EE(chip8_t* cpu, const instruction_t* instruction);  // Return from Subroutine
+void op_1NNN(chip8_t* cpu, const instruction_t* instruction);  // Jump to Address
+void op_2NNN(chip8_t* cpu, const instruction_t* instruction);  // Call Subroutine
+void op_3XNN(chip8_t* cpu, const instruction_t* instruction);  // Skip if Equal
+void op_4XNN(chip8_t* cpu, const instruction_t* instruction);  // Skip if Not Equal
+void op_5XY0(chip8_t* cpu, const instruction_t* instruction);  // Skip if Registers Equal
+void op_6XNN(chip8_t* cpu, const instruction_t* instruction);  // Load Value into Register
+void op_7XNN(chip8_t* cpu, const instruction_t* instruction);  // Add Value to Register
+void op_8XY0(chip8_t* cpu, const instruction_t* instruction);  // Copy Register
+void op_8XY4(chip8_t* cpu, const instruction_t* instruction);  // Add Registers
+void op_8XY5(chip8_t* cpu, const instruction_t* instruction);  // Subtract Registers
+void op_8XY7(chip8_t* cpu, const instruction_t* instruction);  // Subtract Registers (Reverse)
+void op_9XY0(chip8_t* cpu, const instruction_t* instruction);  // Skip if Registers Not Equal
+void op_ANNN(chip8_t* cpu, const instruction_t* instruction);  // Load Address into I
+void op_CXNN(chip8_t* cpu, const instruction_t* instruction);  // Generate Random Number
+void op_EX9E(chip8_t* cpu, const instruction_t* instruction);  // Skip if Key Pressed
+void op_EXA1(chip8_t* cpu, const instruction_t* instruction);  // Skip if Key Not Pressed
+void op_FX07(chip8_t* cpu, const instruction_t* instruction);  // Load Delay Timer into Register
+void op_FX0A(chip8_t* cpu, const instruction_t* instruction);  // Wait for Key Press
+void op_FX15(chip8_t* cpu, const instruction_t* instruction);  // Set Delay Timer
+void op_FX18(chip8_t* cpu, const instruction_t* instruction);  // Set Sound Timer
+void op_FX1E(chip8_t* cpu, const instruction_t* instruction);  // Add to I
+void op_FX29(chip8_t* cpu, const instruction_t* instruction);  // Load Sprite Location
+void op_FX33(chip8_t* cpu, const instruction_t* instruction);  // Store BCD
+void op_F002(chip8_t* cpu, const instruction_t* instruction);  // Load Audio Pattern (XO-CHIP)
+void op_FX3A(chip8_t* cpu, const instruction_t* instruction);  // Set Audio Pitch (XO-CHIP)
+void op_00CN(chip8_t* cpu, const instruction_t* instruction);  // Scroll Down (SUPER-CHIP)
+void op_00FB(chip8_t* cpu, const instruction_t* instruction);  // Scroll Right (SUPER-CHIP)
+void op_00FC(chip8_t* cpu, const instruction_t* instruction);  // Scroll Left (SUPER-CHIP)
+void op_00FE(chip8_t* cpu, const instruction_t* instruction);  // Lo-res Mode (SUPER-CHIP)
+void op_00FF(chip8_t* cpu, const instruction_t* instruction);  // Hi-res Mode (SUPER-CHIP)
+void op_FX30(chip8_t* cpu, const instruction_t* instruction);  // Load Big Sprite Location (SUPER-CHIP)
+void op_FX75(chip8_t* cpu, const instruction_t* instruction);  // Save RPL Flags (SUPER-CHIP)
+void op_FX85(chip8_t* cpu, const instruction_t* instruction);  // Load RPL Flags (SUPER-CHIP)
+void op_00DN(chip8_t* cpu, const instruction_t* instruction);  // Scroll Up (XO-CHIP)
+void op_F000(chip8_t* cpu, const instruction_t* instruction);  // Load Long Address into I (XO-CHIP)
+void op_5XY2(chip8_t* cpu, const instruction_t* instruction);  // Save Register Range (XO-CHIP)
+void op_5XY3(chip8_t* cpu, const instruction_t* instruction);  // Load Register Range (XO-CHIP)
+void op_FN01(chip8_t* cpu, const instruction_t* instruction);  // Select Planes (XO-CHIP)
+
+// 8XY1, 8XY2, 8XY3, 8XY6, 8XYE, BNNN, DXYN, FX55 and FX65 differ between quirk profiles,
+// they only exist as the specializations in `QUIRK_HANDLERS`
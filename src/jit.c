@@ -0,0 +1,689 @@
+#include "jit.h"
+
+#include "chip8.h"
+#include "threaded.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "instructions.h"
+#include "quirks.h"
+
+#define JIT_BUFFER_SIZE (1024 * 1024)  // Executable memory, flushed as a whole when full
+#define JIT_MAX_BLOCK_SIZE 4096         // Upper bound on the native code of one block
+#define JIT_HOT_THRESHOLD 16            // Executions of an address before its block gets compiled
+#define JIT_MAX_REWRITES 8              // Overwrites of a compiled block before it stays in the interpreter
+
+typedef void (*BlockFuncPtr)(chip8_t*);
+
+typedef struct {
+    BlockFuncPtr code;    // Native code, NULL if not compiled
+    uint16_t end;         // First address past the block
+    uint8_t length;       // Instructions in the block
+    uint8_t heat;         // Executions while not compiled
+    uint8_t rewrites;     // Times the compiled block was overwritten
+    bool is_interpreted;  // Never compile, the block keeps being overwritten or can't be compiled
+} jit_block_t;
+
+struct jit {
+    uint8_t* buffer;  // Executable memory
+    size_t used;      // Bytes of `buffer` holding code
+    jit_block_t blocks[MEMORY_SIZE];
+};
+
+// x86-64 register numbers
+enum {
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15
+};
+
+// Host registers V0-VF and I are allocated from, RDI holds the `chip8_t*`, RAX and RCX are scratch
+static const uint8_t REGISTER_POOL[] = {RSI, RDX, R8, R9, R10, R11, RBX, RBP, R12, R13, R14, R15};
+#define REGISTER_POOL_SIZE (sizeof(REGISTER_POOL) / sizeof(REGISTER_POOL[0]))
+#define REGISTER_I REGISTERS_COUNT  // Slot of the I register in the allocation map
+
+// Condition codes for cmov
+#define CC_E 0x4
+#define CC_NE 0x5
+
+// Offsets into `chip8_t`, all addressed as [rdi + disp32]
+#define OFFSET_PC offsetof(chip8_t, pc)
+#define OFFSET_STACK offsetof(chip8_t, stack)
+#define OFFSET_SP offsetof(chip8_t, sp)
+#define OFFSET_V offsetof(chip8_t, v)
+#define OFFSET_I offsetof(chip8_t, i)
+#define OFFSET_DELAY_TIMER offsetof(chip8_t, delay_timer)
+#define OFFSET_SOUND_TIMER offsetof(chip8_t, sound_timer)
+
+typedef struct {
+    uint8_t* code;
+    size_t size;
+} emitter_t;
+
+static void emit8(emitter_t* e, uint8_t byte) {
+    e->code[e->size++] = byte;
+}
+
+static void emit16(emitter_t* e, uint16_t value) {
+    emit8(e, value & 0xFF);
+    emit8(e, value >> 8);
+}
+
+static void emit32(emitter_t* e, uint32_t value) {
+    emit16(e, value & 0xFFFF);
+    emit16(e, value >> 16);
+}
+
+// REX prefix for a ModRM `reg` and `rm`/base operand, `is_byte` forces it for SIL/DIL/BPL/SPL
+static void emit_rex(emitter_t* e, int reg, int rm, bool is_byte) {
+    uint8_t rex = 0x40 | ((reg & 8) ? 0x4 : 0) | ((rm & 8) ? 0x1 : 0);
+    if (rex != 0x40 || (is_byte && reg >= RSP && reg <= RDI)) {
+        emit8(e, rex);
+    }
+}
+
+// ModRM for [rdi + disp32]
+static void emit_mem(emitter_t* e, int reg, uint32_t disp) {
+    emit8(e, 0x80 | (reg & 7) << 3 | RDI);
+    emit32(e, disp);
+}
+
+// mov dst, imm32
+static void emit_mov_ri(emitter_t* e, int dst, uint32_t imm) {
+    emit_rex(e, 0, dst, false);
+    emit8(e, 0xB8 | (dst & 7));
+    emit32(e, imm);
+}
+
+// <op> dst, src with a 32-bit register pair, `opcode` is the r/m32, r32 form
+static void emit_alu_rr(emitter_t* e, uint8_t opcode, int dst, int src) {
+    emit_rex(e, src, dst, false);
+    emit8(e, opcode);
+    emit8(e, 0xC0 | (src & 7) << 3 | (dst & 7));
+}
+
+// <op> dst, imm32, `digit` selects the operation of opcode 0x81
+static void emit_alu_ri(emitter_t* e, int digit, int dst, uint32_t imm) {
+    emit_rex(e, 0, dst, false);
+    emit8(e, 0x81);
+    emit8(e, 0xC0 | digit << 3 | (dst & 7));
+    emit32(e, imm);
+}
+
+// shl/shr dst, imm8, `digit` selects the operation of opcode 0xC1
+static void emit_shift_ri(emitter_t* e, int digit, int dst, uint8_t imm) {
+    emit_rex(e, 0, dst, false);
+    emit8(e, 0xC1);
+    emit8(e, 0xC0 | digit << 3 | (dst & 7));
+    emit8(e, imm);
+}
+
+#define emit_mov_rr(e, dst, src) emit_alu_rr(e, 0x89, dst, src)
+#define emit_add_rr(e, dst, src) emit_alu_rr(e, 0x01, dst, src)
+#define emit_or_rr(e, dst, src) emit_alu_rr(e, 0x09, dst, src)
+#define emit_and_rr(e, dst, src) emit_alu_rr(e, 0x21, dst, src)
+#define emit_sub_rr(e, dst, src) emit_alu_rr(e, 0x29, dst, src)
+#define emit_xor_rr(e, dst, src) emit_alu_rr(e, 0x31, dst, src)
+#define emit_cmp_rr(e, dst, src) emit_alu_rr(e, 0x39, dst, src)
+#define emit_add_ri(e, dst, imm) emit_alu_ri(e, 0, dst, imm)
+#define emit_and_ri(e, dst, imm) emit_alu_ri(e, 4, dst, imm)
+#define emit_xor_ri(e, dst, imm) emit_alu_ri(e, 6, dst, imm)
+#define emit_cmp_ri(e, dst, imm) emit_alu_ri(e, 7, dst, imm)
+#define emit_shl_ri(e, dst, imm) emit_shift_ri(e, 4, dst, imm)
+#define emit_shr_ri(e, dst, imm) emit_shift_ri(e, 5, dst, imm)
+
+// cmov<cc> dst, src
+static void emit_cmov(emitter_t* e, uint8_t cc, int dst, int src) {
+    emit_rex(e, dst, src, false);
+    emit8(e, 0x0F);
+    emit8(e, 0x40 | cc);
+    emit8(e, 0xC0 | (dst & 7) << 3 | (src & 7));
+}
+
+// movzx dst, byte [rdi + disp]
+static void emit_load_u8(emitter_t* e, int dst, uint32_t disp) {
+    emit_rex(e, dst, 0, false);
+    emit8(e, 0x0F);
+    emit8(e, 0xB6);
+    emit_mem(e, dst, disp);
+}
+
+// movzx dst, word [rdi + disp]
+static void emit_load_u16(emitter_t* e, int dst, uint32_t disp) {
+    emit_rex(e, dst, 0, false);
+    emit8(e, 0x0F);
+    emit8(e, 0xB7);
+    emit_mem(e, dst, disp);
+}
+
+// mov byte [rdi + disp], src
+static void emit_store_u8(emitter_t* e, int src, uint32_t disp) {
+    emit_rex(e, src, 0, true);
+    emit8(e, 0x88);
+    emit_mem(e, src, disp);
+}
+
+// mov word [rdi + disp], src
+static void emit_store_u16(emitter_t* e, int src, uint32_t disp) {
+    emit8(e, 0x66);
+    emit_rex(e, src, 0, false);
+    emit8(e, 0x89);
+    emit_mem(e, src, disp);
+}
+
+// mov word [rdi + disp], imm16
+static void emit_store_u16_imm(emitter_t* e, uint32_t disp, uint16_t imm) {
+    emit8(e, 0x66);
+    emit8(e, 0xC7);
+    emit_mem(e, 0, disp);
+    emit16(e, imm);
+}
+
+// ModRM and SIB for [rdi + rax * 2 + disp32]
+static void emit_mem_stack(emitter_t* e, int reg) {
+    emit8(e, 0x84 | (reg & 7) << 3);
+    emit8(e, 0x40 | RAX << 3 | RDI);
+    emit32(e, OFFSET_STACK);
+}
+
+static void emit_push(emitter_t* e, int reg) {
+    emit_rex(e, 0, reg, false);
+    emit8(e, 0x50 | (reg & 7));
+}
+
+static void emit_pop(emitter_t* e, int reg) {
+    emit_rex(e, 0, reg, false);
+    emit8(e, 0x58 | (reg & 7));
+}
+
+static bool is_callee_saved(int reg) {
+    return reg == RBX || reg == RBP || reg >= R12;
+}
+
+// Ops translated to native code, everything else ends the block and runs in the interpreter
+static bool is_compilable(uint8_t op) {
+    switch (op) {
+        case OP_00EE:
+        case OP_1NNN:
+        case OP_2NNN:
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_6XNN:
+        case OP_7XNN:
+        case OP_8XY0:
+        case OP_8XY1:
+        case OP_8XY2:
+        case OP_8XY3:
+        case OP_8XY4:
+        case OP_8XY5:
+        case OP_8XY6:
+        case OP_8XY7:
+        case OP_8XYE:
+        case OP_9XY0:
+        case OP_ANNN:
+        case OP_FX07:
+        case OP_FX15:
+        case OP_FX18:
+        case OP_FX1E:
+        case OP_FX29:
+            return true;
+    }
+    return false;
+}
+
+static bool is_block_end(uint8_t op) {
+    switch (op) {
+        case OP_00EE:
+        case OP_1NNN:
+        case OP_2NNN:
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_9XY0:
+            return true;
+    }
+    return false;
+}
+
+// Registers an op reads or writes, as a bit mask over V0-VF and I
+static uint32_t get_used_registers(const instruction_t* instruction) {
+    uint32_t x = 1u << instruction->x;
+    uint32_t y = 1u << instruction->y;
+    uint32_t f = 1u << 0xF;
+    uint32_t i = 1u << REGISTER_I;
+
+    switch (instruction->op) {
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_6XNN:
+        case OP_7XNN:
+        case OP_FX07:
+        case OP_FX15:
+        case OP_FX18:
+            return x;
+        case OP_5XY0:
+        case OP_8XY0:
+        case OP_9XY0:
+            return x | y;
+        case OP_8XY1:
+        case OP_8XY2:
+        case OP_8XY3:
+        case OP_8XY4:
+        case OP_8XY5:
+        case OP_8XY6:
+        case OP_8XY7:
+        case OP_8XYE:
+            return x | y | f;
+        case OP_ANNN:
+            return i;
+        case OP_FX1E:
+        case OP_FX29:
+            return x | i;
+    }
+    return 0;
+}
+
+// Registers an op writes, a subset of `get_used_registers`
+static uint32_t get_written_registers(const instruction_t* instruction) {
+    switch (instruction->op) {
+        case OP_6XNN:
+        case OP_7XNN:
+        case OP_8XY0:
+        case OP_FX07:
+            return 1u << instruction->x;
+        case OP_8XY1:
+        case OP_8XY2:
+        case OP_8XY3:
+        case OP_8XY4:
+        case OP_8XY5:
+        case OP_8XY6:
+        case OP_8XY7:
+        case OP_8XYE:
+            return 1u << instruction->x | 1u << 0xF;
+        case OP_ANNN:
+        case OP_FX1E:
+        case OP_FX29:
+            return 1u << REGISTER_I;
+    }
+    return 0;
+}
+
+// Quirks are known when the block is compiled, so the native code is specialized like the handlers
+static void emit_instruction(emitter_t* e, const instruction_t* instruction, uint16_t pc, const int8_t* host,
+                             const quirk_profile_t* quirks) {
+    int x = host[instruction->x];
+    int y = host[instruction->y];
+    int shifted = quirks->is_shift_vy ? y : x;
+    int f = host[0xF];
+    int i = host[REGISTER_I];
+
+    switch (instruction->op) {
+        case OP_00EE:
+            emit8(e, 0xFE);  // dec byte [rdi + sp]
+            emit_mem(e, 1, OFFSET_SP);
+            emit_load_u8(e, RAX, OFFSET_SP);
+            emit_and_ri(e, RAX, STACK_SIZE - 1);
+            emit8(e, 0x0F);  // movzx eax, word [rdi + rax * 2 + stack]
+            emit8(e, 0xB7);
+            emit_mem_stack(e, RAX);
+            emit_store_u16(e, RAX, OFFSET_PC);
+            break;
+        case OP_1NNN:
+            emit_store_u16_imm(e, OFFSET_PC, instruction->nnn);
+            break;
+        case OP_2NNN:
+            emit_load_u8(e, RAX, OFFSET_SP);
+            emit_and_ri(e, RAX, STACK_SIZE - 1);
+            emit8(e, 0x66);  // mov word [rdi + rax * 2 + stack], imm16
+            emit8(e, 0xC7);
+            emit_mem_stack(e, 0);
+            emit16(e, pc + 2);
+            emit8(e, 0xFE);  // inc byte [rdi + sp]
+            emit_mem(e, 0, OFFSET_SP);
+            emit_store_u16_imm(e, OFFSET_PC, instruction->nnn);
+            break;
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_9XY0:
+            emit_mov_ri(e, RAX, pc + 2);
+            emit_mov_ri(e, RCX, pc + 2 + instruction->skip);
+            if (instruction->op == OP_3XNN || instruction->op == OP_4XNN) {
+                emit_cmp_ri(e, x, instruction->nn);
+            } else {
+                emit_cmp_rr(e, x, y);
+            }
+            emit_cmov(e, instruction->op == OP_3XNN || instruction->op == OP_5XY0 ? CC_E : CC_NE, RAX, RCX);
+            emit_store_u16(e, RAX, OFFSET_PC);
+            break;
+        case OP_6XNN:
+            emit_mov_ri(e, x, instruction->nn);
+            break;
+        case OP_7XNN:
+            emit_add_ri(e, x, instruction->nn);
+            emit_and_ri(e, x, 0xFF);
+            break;
+        case OP_8XY0:
+            emit_mov_rr(e, x, y);
+            break;
+        case OP_8XY1:
+            emit_or_rr(e, x, y);
+            if (quirks->is_vf_reset) {
+                emit_mov_ri(e, f, 0);
+            }
+            break;
+        case OP_8XY2:
+            emit_and_rr(e, x, y);
+            if (quirks->is_vf_reset) {
+                emit_mov_ri(e, f, 0);
+            }
+            break;
+        case OP_8XY3:
+            emit_xor_rr(e, x, y);
+            if (quirks->is_vf_reset) {
+                emit_mov_ri(e, f, 0);
+            }
+            break;
+        case OP_8XY4:
+            emit_mov_rr(e, RAX, x);
+            emit_add_rr(e, RAX, y);
+            emit_mov_rr(e, RCX, RAX);
+            emit_shr_ri(e, RCX, 8);
+            emit_and_ri(e, RAX, 0xFF);
+            emit_mov_rr(e, x, RAX);
+            emit_mov_rr(e, f, RCX);
+            break;
+        case OP_8XY5:
+        case OP_8XY7:
+            // The interpreter sets VF from the sign of the 8-bit result
+            if (instruction->op == OP_8XY5) {
+                emit_mov_rr(e, RAX, x);
+                emit_sub_rr(e, RAX, y);
+            } else {
+                emit_mov_rr(e, RAX, y);
+                emit_sub_rr(e, RAX, x);
+            }
+            emit_and_ri(e, RAX, 0xFF);
+            emit_mov_rr(e, RCX, RAX);
+            emit_shr_ri(e, RCX, 7);
+            emit_xor_ri(e, RCX, 1);
+            emit_mov_rr(e, x, RAX);
+            emit_mov_rr(e, f, RCX);
+            break;
+        case OP_8XY6:
+            emit_mov_rr(e, RAX, shifted);
+            emit_mov_rr(e, RCX, RAX);
+            emit_shr_ri(e, RAX, 1);
+            emit_and_ri(e, RCX, 1);
+            emit_mov_rr(e, x, RAX);
+            emit_mov_rr(e, f, RCX);
+            break;
+        case OP_8XYE:
+            emit_mov_rr(e, RAX, shifted);
+            emit_mov_rr(e, RCX, RAX);
+            emit_shl_ri(e, RAX, 1);
+            emit_and_ri(e, RAX, 0xFF);
+            emit_shr_ri(e, RCX, 7);
+            emit_mov_rr(e, x, RAX);
+            emit_mov_rr(e, f, RCX);
+            break;
+        case OP_ANNN:
+            emit_mov_ri(e, i, instruction->nnn);
+            break;
+        case OP_FX07:
+            emit_load_u8(e, x, OFFSET_DELAY_TIMER);
+            break;
+        case OP_FX15:
+            emit_store_u8(e, x, OFFSET_DELAY_TIMER);
+            break;
+        case OP_FX18:
+            emit_store_u8(e, x, OFFSET_SOUND_TIMER);
+            break;
+        case OP_FX1E:
+            emit_add_rr(e, i, x);
+            emit_and_ri(e, i, 0xFFFF);
+            break;
+        case OP_FX29:
+            // lea i, [x + x * 4 + FONTSET_START_ADDR]
+            if ((i | x) & 8) {
+                emit8(e, 0x40 | ((i & 8) ? 0x4 : 0) | ((x & 8) ? 0x3 : 0));
+            }
+            emit8(e, 0x8D);
+            emit8(e, 0x84 | (i & 7) << 3);
+            emit8(e, 0x80 | (x & 7) << 3 | (x & 7));
+            emit32(e, FONTSET_START_ADDR);
+            break;
+    }
+}
+
+// Translate the block at `start`, returns the number of instructions compiled
+static int compile_block(jit_t* jit, chip8_t* cpu, uint16_t start) {
+    const instruction_t* instructions[BLOCK_MAX_LENGTH];
+    uint32_t used = 0;
+    uint32_t written = 0;
+    int length = 0;
+
+    // Collect instructions while the registers they use fit in the pool
+    uint16_t address = start;
+    while (length < BLOCK_MAX_LENGTH && address <= MEMORY_SIZE - 2) {
+        const instruction_t* instruction = fetch_instruction(cpu, address);
+        if (!is_compilable(instruction->op)) {
+            break;
+        }
+
+        uint32_t next_used = used | get_used_registers(instruction);
+        if (__builtin_popcount(next_used) > (int)REGISTER_POOL_SIZE) {
+            break;
+        }
+        used = next_used;
+        written |= get_written_registers(instruction);
+        instructions[length++] = instruction;
+
+        if (is_block_end(instruction->op)) {
+            break;
+        }
+        address += 2;
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    // Allocate host registers
+    int8_t host[REGISTERS_COUNT + 1];
+    int allocated = 0;
+    for (int r = 0; r <= REGISTER_I; r++) {
+        host[r] = (used & (1u << r)) ? REGISTER_POOL[allocated++] : -1;
+    }
+
+    uint8_t code[JIT_MAX_BLOCK_SIZE];
+    emitter_t e = {.code = code};
+
+    // Prologue, load guest registers
+    for (int r = 0; r < allocated; r++) {
+        if (is_callee_saved(REGISTER_POOL[r])) emit_push(&e, REGISTER_POOL[r]);
+    }
+    for (int r = 0; r < REGISTERS_COUNT; r++) {
+        if (host[r] >= 0) emit_load_u8(&e, host[r], OFFSET_V + r);
+    }
+    if (host[REGISTER_I] >= 0) {
+        emit_load_u16(&e, host[REGISTER_I], OFFSET_I);
+    }
+
+    for (int n = 0; n < length; n++) {
+        emit_instruction(&e, instructions[n], start + n * 2, host, &QUIRK_PROFILES[cpu->quirks]);
+    }
+
+    // Fall through to the next instruction if the block wasn't ended by control flow
+    if (!is_block_end(instructions[length - 1]->op)) {
+        emit_store_u16_imm(&e, OFFSET_PC, start + length * 2);
+    }
+
+    // Epilogue, write modified guest registers back
+    for (int r = 0; r < REGISTERS_COUNT; r++) {
+        if (written & (1u << r)) emit_store_u8(&e, host[r], OFFSET_V + r);
+    }
+    if (written & (1u << REGISTER_I)) {
+        emit_store_u16(&e, host[REGISTER_I], OFFSET_I);
+    }
+    for (int r = allocated - 1; r >= 0; r--) {
+        if (is_callee_saved(REGISTER_POOL[r])) emit_pop(&e, REGISTER_POOL[r]);
+    }
+    emit8(&e, 0xC3);  // ret
+
+    // Start over once the buffer is full, every block gets recompiled when it's hot again
+    if (jit->used + e.size > JIT_BUFFER_SIZE) {
+        for (int a = 0; a < MEMORY_SIZE; a++) {
+            jit->blocks[a].code = NULL;
+            jit->blocks[a].heat = 0;
+        }
+        jit->used = 0;
+    }
+
+    // Keep the buffer W^X, writable only while copying the new block in
+    uint8_t* destination = jit->buffer + jit->used;
+    if (mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return 0;
+    }
+    memcpy(destination, code, e.size);
+    if (mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        return 0;
+    }
+    jit->used += e.size;
+
+    jit_block_t* block = &jit->blocks[start];
+    block->code = (BlockFuncPtr)destination;
+    block->end = start + length * 2;
+    block->length = length;
+    return length;
+}
+
+bool is_jit_supported(void) {
+    return true;
+}
+
+jit_t* jit_create(void) {
+    jit_t* jit = calloc(1, sizeof(jit_t));
+    if (!jit) {
+        return NULL;
+    }
+
+    jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->buffer == MAP_FAILED) {
+        free(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+void jit_destroy(jit_t* jit) {
+    if (!jit) {
+        return;
+    }
+    munmap(jit->buffer, JIT_BUFFER_SIZE);
+    free(jit);
+}
+
+void jit_invalidate(jit_t* jit, uint16_t address, uint16_t size) {
+    // Blocks overlapping the written range are dropped, including the opcode after them, which decides how far
+    // a skip ending the block jumps, they get recompiled once hot again, unless they keep being rewritten
+    for (int i = -2 * BLOCK_MAX_LENGTH - 2; i < size; i++) {
+        jit_block_t* block = &jit->blocks[(address + i) & (MEMORY_SIZE - 1)];
+        uint16_t start = (address + i) & (MEMORY_SIZE - 1);
+        if (block->code && start < address + size && block->end + 2 > address) {
+            block->code = NULL;
+            block->heat = 0;
+            block->is_interpreted = ++block->rewrites >= JIT_MAX_REWRITES;
+        }
+    }
+}
+
+// Returns the instructions run, less than `budget` if one started waiting
+int run_jit(chip8_t* cpu, int budget) {
+    if (!cpu->jit) {
+        cpu->jit = jit_create();
+        if (!cpu->jit) {
+            return run_threaded(cpu, budget);
+        }
+    }
+
+    jit_t* jit = cpu->jit;
+    int executed = 0;
+
+    while (executed < budget) {
+        uint16_t pc = cpu->pc;
+        if (pc > MEMORY_SIZE - 2) {
+            step_chip8(cpu);
+            executed++;
+            if (cpu->wait_state) break;
+            continue;
+        }
+
+        // Interpret until the block is hot, and blocks that can't be compiled
+        jit_block_t* block = &jit->blocks[pc];
+        if (!block->code) {
+            if (block->is_interpreted || ++block->heat < JIT_HOT_THRESHOLD || !compile_block(jit, cpu, pc)) {
+                block->is_interpreted |= block->heat >= JIT_HOT_THRESHOLD;
+                step_chip8(cpu);
+                executed++;
+                if (cpu->wait_state) break;
+                continue;
+            }
+        }
+
+        // Finish the frame in the interpreter if the whole block doesn't fit the budget
+        if (block->length > budget - executed) {
+            while (executed < budget && !cpu->wait_state) {
+                step_chip8(cpu);
+                executed++;
+            }
+            break;
+        }
+
+        block->code(cpu);
+        executed += block->length;
+    }
+
+    return executed;
+}
+
+#else
+
+bool is_jit_supported(void) {
+    return false;
+}
+
+jit_t* jit_create(void) {
+    return NULL;
+}
+
+void jit_destroy(jit_t* jit) {
+}
+
+void jit_invalidate(jit_t* jit, uint16_t address, uint16_t size) {
+}
+
+// No native code generation on this platform, fall back to the threaded backend
+int run_jit(chip8_t* cpu, int budget) {
+    return run_threaded(cpu, budget);
+}
+
+#endif
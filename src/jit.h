@@ -0,0 +1,9 @@
+#pragma once
+
+#include "chip8_t.h"
+
+bool is_jit_supported(void);
+jit_t* jit_create(void);
+void jit_destroy(jit_t* jit);
+void jit_invalidate(jit_t* jit, uint16_t address, uint16_t size);
+int run_jit(chip8_t* cpu, int budget);
@@ -1,5 +1,7 @@
 #include "keyboard.h"
 
+#include "chip8_t.h"
+
 typedef struct {
     SDL_Scancode scancode;
     uint8_t value;
@@ -14,12 +16,12 @@ static const keymap_t KEYMAP[KEYBOARD_SIZE] = {
 };
 // clang-format on
 
-void handle_key_event(SDL_Event* event, chip8_t* cpu) {
-    bool is_key_down = event->type == SDL_EVENT_KEY_DOWN;
+// Returns the CHIP-8 key mapped to the scancode, or -1 for unmapped keys
+int get_chip8_key(SDL_Scancode scancode) {
     for (int i = 0; i < KEYBOARD_SIZE; i++) {
-        if (event->key.scancode == KEYMAP[i].scancode) {
-            cpu->keyboard[KEYMAP[i].value] = is_key_down;
-            return;
+        if (scancode == KEYMAP[i].scancode) {
+            return KEYMAP[i].value;
         }
     }
+    return -1;
 }
@@ -1,5 +1,3 @@
 #include <SDL3/SDL.h>
 
-#include "chip8_t.h"
-
-void handle_key_event(SDL_Event* event, chip8_t* cpu);
+int get_chip8_key(SDL_Scancode scancode);
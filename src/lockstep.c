@@ -0,0 +1,443 @@
+#include "lockstep.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "instructions.h"
+#include "quirks.h"
+
+#define ALL_LANES ((1u << LOCKSTEP_LANES) - 1)
+
+// One element per lane. GCC and Clang compile them to SSE/AVX2 registers and every lane statement runs once
+// on whole vectors, other compilers get plain arrays and run each lane statement in a loop over the lanes
+#if defined(__GNUC__)
+typedef uint8_t lanes_u8_t __attribute__((vector_size(LOCKSTEP_LANES)));
+typedef uint16_t lanes_u16_t __attribute__((vector_size(LOCKSTEP_LANES * 2)));
+typedef int16_t lanes_i16_t __attribute__((vector_size(LOCKSTEP_LANES * 2)));
+typedef lanes_u8_t lane_u8_t;  // Value of a lane statement
+
+#define LANE_LOOP_COUNT 1
+#define LANE(lanes) (lanes)
+#define SPLAT_U8(value) ((lanes_u8_t){} + (value))
+#define SPLAT_U16(value) ((lanes_u16_t){} + (value))
+#define MASK_U8(condition) ((lanes_u8_t)(condition))  // All ones where true
+#define MASK_U16(condition) ((lanes_u16_t)__builtin_convertvector(condition, lanes_i16_t))
+#define WIDEN(value) __builtin_convertvector(value, lanes_u16_t)
+#else
+typedef uint8_t lanes_u8_t[LOCKSTEP_LANES];
+typedef uint16_t lanes_u16_t[LOCKSTEP_LANES];
+typedef uint8_t lane_u8_t;
+
+#define LANE_LOOP_COUNT LOCKSTEP_LANES
+#define LANE(lanes) (lanes)[lane]
+#define SPLAT_U8(value) (value)
+#define SPLAT_U16(value) (value)
+#define MASK_U8(condition) ((condition) ? 0xFF : 0)
+#define MASK_U16(condition) ((condition) ? 0xFFFF : 0)
+#define WIDEN(value) ((uint16_t)(value))
+#endif
+
+// Run a statement on `LANE` of every lane
+#define FOR_EACH_LANE(...)                               \
+    for (int lane = 0; lane < LANE_LOOP_COUNT; lane++) { \
+        __VA_ARGS__;                                     \
+    }
+
+// Skip the next instruction in the lanes where the comparison is true
+#define SKIP_IF(condition) FOR_EACH_LANE(LANE(lockstep->pc) += MASK_U16(condition) & instruction.skip)
+
+struct lockstep {
+    // Registers of every lane, transposed into vectors for the length of a run
+    lanes_u16_t pc;
+    lanes_u16_t i;
+    lanes_u8_t v[REGISTERS_COUNT];
+    lanes_u8_t sp;
+    lanes_u8_t delay_timer;
+    lanes_u8_t sound_timer;
+
+    bool is_memory_shared;  // Cleared once any lane writes to memory, lanes may run different code from then on
+
+    chip8_t lanes[LOCKSTEP_LANES];  // Memory, stack, display, keyboard and decode cache of every lane
+};
+
+static void load_lane(lockstep_t* lockstep, int lane) {
+    chip8_t* cpu = &lockstep->lanes[lane];
+    lockstep->pc[lane] = cpu->pc;
+    lockstep->i[lane] = cpu->i;
+    for (int x = 0; x < REGISTERS_COUNT; x++) {
+        lockstep->v[x][lane] = cpu->v[x];
+    }
+    lockstep->sp[lane] = cpu->sp;
+    lockstep->delay_timer[lane] = cpu->delay_timer;
+    lockstep->sound_timer[lane] = cpu->sound_timer;
+}
+
+static void store_lane(lockstep_t* lockstep, int lane) {
+    chip8_t* cpu = &lockstep->lanes[lane];
+    cpu->pc = lockstep->pc[lane];
+    cpu->i = lockstep->i[lane];
+    for (int x = 0; x < REGISTERS_COUNT; x++) {
+        cpu->v[x] = lockstep->v[x][lane];
+    }
+    cpu->sp = lockstep->sp[lane];
+    cpu->delay_timer = lockstep->delay_timer[lane];
+    cpu->sound_timer = lockstep->sound_timer[lane];
+}
+
+// Run one instruction of a single lane with the regular handlers
+static void step_lane(lockstep_t* lockstep, int lane) {
+    chip8_t* cpu = &lockstep->lanes[lane];
+    store_lane(lockstep, lane);
+
+    uint8_t op = fetch_instruction(cpu, cpu->pc)->op;
+    if (op == OP_FX33 || op == OP_FX55 || op == OP_5XY2) {
+        lockstep->is_memory_shared = false;
+    }
+    step_chip8(cpu);
+
+    load_lane(lockstep, lane);
+}
+
+static bool is_i_shared(const lockstep_t* lockstep) {
+    for (int lane = 1; lane < LOCKSTEP_LANES; lane++) {
+        if (lockstep->i[lane] != lockstep->i[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Run an already fetched instruction in every lane with the regular handlers
+static void call_lanes(lockstep_t* lockstep, const instruction_t* instruction) {
+    // Memory stays shared as long as every lane writes the same bytes to the same address
+    uint16_t address = lockstep->i[0];
+    uint16_t size = 0;
+    if (instruction->op == OP_FX33 || instruction->op == OP_FX55) {
+        size = instruction->op == OP_FX33 ? 3 : instruction->x + 1;
+    } else if (instruction->op == OP_5XY2) {
+        size = abs(instruction->x - instruction->y) + 1;
+    }
+    if (size && (!is_i_shared(lockstep) || address + size > MEMORY_SIZE)) {
+        lockstep->is_memory_shared = false;
+    }
+
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        store_lane(lockstep, lane);
+        instruction->handler(&lockstep->lanes[lane], instruction);
+        load_lane(lockstep, lane);
+    }
+
+    const uint8_t* memory = &lockstep->lanes[0].memory[address];
+    for (int lane = 1; size && lockstep->is_memory_shared && lane < LOCKSTEP_LANES; lane++) {
+        lockstep->is_memory_shared = memcmp(&lockstep->lanes[lane].memory[address], memory, size) == 0;
+    }
+}
+
+static bool is_any_waiting(const lockstep_t* lockstep) {
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        if (lockstep->lanes[lane].wait_state) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_converged(const lockstep_t* lockstep) {
+    for (int lane = 1; lane < LOCKSTEP_LANES; lane++) {
+        if (lockstep->pc[lane] != lockstep->pc[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether every lane sees the same instruction at their common program counter
+static bool is_opcode_shared(const lockstep_t* lockstep) {
+    uint16_t pc = lockstep->pc[0];
+    if (pc > MEMORY_SIZE - 4) {
+        return false;
+    }
+    if (lockstep->is_memory_shared) {
+        return true;
+    }
+
+    // The next opcode as well, it's the address of F000 NNNN and decides how far skips jump
+    const uint8_t* memory = lockstep->lanes[0].memory;
+    for (int lane = 1; lane < LOCKSTEP_LANES; lane++) {
+        if (memcmp(&lockstep->lanes[lane].memory[pc], &memory[pc], 4) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Run up to `budget` instructions in every lane at once, returns the number run before the lanes diverged,
+// specialized per quirk profile by `DEFINE_RUN_CONVERGED` like the handlers
+static ALWAYS_INLINE int run_converged_quirks(lockstep_t* lockstep, int budget, bool is_vf_reset, bool is_shift_vy) {
+    lanes_u8_t* v = lockstep->v;
+
+    for (int executed = 0; executed < budget;) {
+        if (executed && !is_opcode_shared(lockstep)) {
+            return executed;
+        }
+
+        // Copy, a lane writing memory may invalidate the cache entry
+        instruction_t instruction = *fetch_instruction(&lockstep->lanes[0], lockstep->pc[0]);
+        uint8_t x = instruction.x;
+        uint8_t y = instruction.y;
+        FOR_EACH_LANE(LANE(lockstep->pc) += 2);
+        executed++;
+
+        switch (instruction.op) {
+            case OP_1NNN:
+                FOR_EACH_LANE(LANE(lockstep->pc) = SPLAT_U16(instruction.nnn));
+                break;
+            case OP_2NNN:
+                for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    lockstep->lanes[lane].stack[lockstep->sp[lane] % STACK_SIZE] = lockstep->pc[lane];
+                }
+                FOR_EACH_LANE(LANE(lockstep->sp) += 1);
+                FOR_EACH_LANE(LANE(lockstep->pc) = SPLAT_U16(instruction.nnn));
+                break;
+            case OP_00EE:
+                FOR_EACH_LANE(LANE(lockstep->sp) -= 1);
+                for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    lockstep->pc[lane] = lockstep->lanes[lane].stack[lockstep->sp[lane] % STACK_SIZE];
+                }
+                if (!is_converged(lockstep)) return executed;
+                break;
+            case OP_3XNN:
+                SKIP_IF(LANE(v[x]) == instruction.nn);
+                if (!is_converged(lockstep)) return executed;
+                break;
+            case OP_4XNN:
+                SKIP_IF(LANE(v[x]) != instruction.nn);
+                if (!is_converged(lockstep)) return executed;
+                break;
+            case OP_5XY0:
+                SKIP_IF(LANE(v[x]) == LANE(v[y]));
+                if (!is_converged(lockstep)) return executed;
+                break;
+            case OP_9XY0:
+                SKIP_IF(LANE(v[x]) != LANE(v[y]));
+                if (!is_converged(lockstep)) return executed;
+                break;
+            case OP_6XNN:
+                FOR_EACH_LANE(LANE(v[x]) = SPLAT_U8(instruction.nn));
+                break;
+            case OP_7XNN:
+                FOR_EACH_LANE(LANE(v[x]) += instruction.nn);
+                break;
+            case OP_8XY0:
+                FOR_EACH_LANE(LANE(v[x]) = LANE(v[y]));
+                break;
+            case OP_8XY1:
+                FOR_EACH_LANE(LANE(v[x]) |= LANE(v[y]));
+                if (is_vf_reset) {
+                    FOR_EACH_LANE(LANE(v[0xF]) = SPLAT_U8(0));
+                }
+                break;
+            case OP_8XY2:
+                FOR_EACH_LANE(LANE(v[x]) &= LANE(v[y]));
+                if (is_vf_reset) {
+                    FOR_EACH_LANE(LANE(v[0xF]) = SPLAT_U8(0));
+                }
+                break;
+            case OP_8XY3:
+                FOR_EACH_LANE(LANE(v[x]) ^= LANE(v[y]));
+                if (is_vf_reset) {
+                    FOR_EACH_LANE(LANE(v[0xF]) = SPLAT_U8(0));
+                }
+                break;
+            case OP_8XY4:
+                FOR_EACH_LANE({
+                    lane_u8_t sum = LANE(v[x]) + LANE(v[y]);
+                    lane_u8_t carry = MASK_U8(sum < LANE(v[x])) & 1;
+                    LANE(v[x]) = sum;
+                    LANE(v[0xF]) = carry;
+                });
+                break;
+            case OP_8XY5:
+                // Same flag as the interpreter, set when the difference has its sign bit clear
+                FOR_EACH_LANE({
+                    lane_u8_t sub = LANE(v[x]) - LANE(v[y]);
+                    LANE(v[x]) = sub;
+                    LANE(v[0xF]) = MASK_U8(sub < 0x80) & 1;
+                });
+                break;
+            case OP_8XY6:
+                FOR_EACH_LANE({
+                    lane_u8_t value = is_shift_vy ? LANE(v[y]) : LANE(v[x]);
+                    LANE(v[x]) = value >> 1;
+                    LANE(v[0xF]) = value & 1;
+                });
+                break;
+            case OP_8XY7:
+                FOR_EACH_LANE({
+                    lane_u8_t sub = LANE(v[y]) - LANE(v[x]);
+                    LANE(v[x]) = sub;
+                    LANE(v[0xF]) = MASK_U8(sub < 0x80) & 1;
+                });
+                break;
+            case OP_8XYE:
+                FOR_EACH_LANE({
+                    lane_u8_t value = is_shift_vy ? LANE(v[y]) : LANE(v[x]);
+                    LANE(v[x]) = value << 1;
+                    LANE(v[0xF]) = value >> 7;
+                });
+                break;
+            case OP_ANNN:
+                FOR_EACH_LANE(LANE(lockstep->i) = SPLAT_U16(instruction.nnn));
+                break;
+            case OP_FX07:
+                FOR_EACH_LANE(LANE(v[x]) = LANE(lockstep->delay_timer));
+                break;
+            case OP_FX15:
+                FOR_EACH_LANE(LANE(lockstep->delay_timer) = LANE(v[x]));
+                break;
+            case OP_FX18:
+                FOR_EACH_LANE(LANE(lockstep->sound_timer) = LANE(v[x]));
+                break;
+            case OP_FX1E:
+                FOR_EACH_LANE(LANE(lockstep->i) += WIDEN(LANE(v[x])));
+                break;
+            case OP_FX29:
+                FOR_EACH_LANE(LANE(lockstep->i) = WIDEN(LANE(v[x])) * 5 + FONTSET_START_ADDR);
+                break;
+            default:
+                // Display, keyboard, memory and random ops run lane by lane, DXYN and FX0A may leave lanes waiting
+                call_lanes(lockstep, &instruction);
+                if (!is_converged(lockstep) || is_any_waiting(lockstep)) return executed;
+                break;
+        }
+    }
+    return budget;
+}
+
+#define DEFINE_RUN_CONVERGED(id, name, vf_reset, memory, shift_vy, ...)    \
+    static int run_converged_##id(lockstep_t* lockstep, int budget) {       \
+        return run_converged_quirks(lockstep, budget, vf_reset, shift_vy);  \
+    }
+
+FOR_EACH_QUIRK_PROFILE(DEFINE_RUN_CONVERGED)
+
+#define RUN_CONVERGED_ENTRY(id, ...) [QUIRKS_##id] = run_converged_##id,
+
+static int (*const RUN_CONVERGED[QUIRKS_COUNT])(lockstep_t*, int) = {FOR_EACH_QUIRK_PROFILE(RUN_CONVERGED_ENTRY)};
+
+lockstep_t* lockstep_create(void) {
+    // The register vectors need their natural alignment for aligned vector loads
+    size_t alignment = sizeof(lanes_u16_t);
+    size_t size = (sizeof(lockstep_t) + alignment - 1) / alignment * alignment;
+    lockstep_t* lockstep = aligned_alloc(alignment, size);
+    if (!lockstep) {
+        return NULL;
+    }
+    memset(lockstep, 0, size);
+
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        init_chip8(&lockstep->lanes[lane]);
+    }
+    return lockstep;
+}
+
+void lockstep_destroy(lockstep_t* lockstep) {
+    if (!lockstep) {
+        return;
+    }
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        cleanup_chip8(&lockstep->lanes[lane]);
+    }
+    free(lockstep);
+}
+
+bool lockstep_load_rom(lockstep_t* lockstep, const char* filename) {
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        if (!load_rom(&lockstep->lanes[lane], filename)) {
+            return false;
+        }
+    }
+
+    lockstep->is_memory_shared = true;
+    for (int lane = 1; lane < LOCKSTEP_LANES; lane++) {
+        lockstep->is_memory_shared &= memcmp(lockstep->lanes[lane].memory, lockstep->lanes[0].memory, MEMORY_SIZE) == 0;
+    }
+    return true;
+}
+
+void lockstep_set_quirks(lockstep_t* lockstep, quirks_t quirks) {
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        set_chip8_quirks(&lockstep->lanes[lane], quirks);
+    }
+}
+
+chip8_t* lockstep_get(lockstep_t* lockstep, int lane) {
+    return &lockstep->lanes[lane];
+}
+
+int run_lockstep_frame(lockstep_t* lockstep, int budget) {
+    int executed[LOCKSTEP_LANES] = {0};
+    int total = 0;
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        wake_chip8(&lockstep->lanes[lane]);
+        load_lane(lockstep, lane);
+    }
+
+    while (true) {
+        // Pick the lanes furthest behind in the program, so lanes that took different paths can meet again
+        uint32_t lanes = 0;
+        uint16_t lowest_pc = 0;
+        int remaining = budget;
+        for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+            if (executed[lane] == budget) {
+                continue;
+            }
+            // Waiting lanes sleep through the rest of the frame
+            if (lockstep->lanes[lane].wait_state) {
+                executed[lane] = budget;
+                continue;
+            }
+            if (!lanes || lockstep->pc[lane] < lowest_pc) {
+                lanes = 0;
+                lowest_pc = lockstep->pc[lane];
+            }
+            if (lockstep->pc[lane] == lowest_pc) {
+                lanes |= 1u << lane;
+                if (budget - executed[lane] < remaining) {
+                    remaining = budget - executed[lane];
+                }
+            }
+        }
+        if (!lanes) {
+            break;
+        }
+
+        if (lanes == ALL_LANES && is_opcode_shared(lockstep)) {
+            int count = RUN_CONVERGED[lockstep->lanes[0].quirks](lockstep, remaining);
+            for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                executed[lane] += count;
+            }
+            total += count * LOCKSTEP_LANES;
+            continue;
+        }
+
+        // Diverged, run the lanes that are behind one instruction at a time
+        for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+            if (lanes & (1u << lane)) {
+                step_lane(lockstep, lane);
+                executed[lane]++;
+                total++;
+            }
+        }
+    }
+
+    // Tick the timers of every lane, then store the registers back into the lanes
+    FOR_EACH_LANE(LANE(lockstep->delay_timer) -= MASK_U8(LANE(lockstep->delay_timer) != 0) & 1);
+    FOR_EACH_LANE(LANE(lockstep->sound_timer) -= MASK_U8(LANE(lockstep->sound_timer) != 0) & 1);
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        store_lane(lockstep, lane);
+        lockstep->lanes[lane].instruction_count += executed[lane];
+        lockstep->lanes[lane].is_redraw_needed = false;
+    }
+    return total;
+}
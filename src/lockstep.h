@@ -0,0 +1,16 @@
+#pragma once
+
+#include "chip8.h"
+
+#define LOCKSTEP_LANES 16
+
+typedef struct lockstep lockstep_t;
+
+// Lanes are regular machines between runs, e.g. to set each lane's keyboard,
+// except for the quirk profile, which every lane shares
+lockstep_t* lockstep_create(void);
+void lockstep_destroy(lockstep_t* lockstep);
+bool lockstep_load_rom(lockstep_t* lockstep, const char* filename);
+void lockstep_set_quirks(lockstep_t* lockstep, quirks_t quirks);
+chip8_t* lockstep_get(lockstep_t* lockstep, int lane);
+int run_lockstep_frame(lockstep_t* lockstep, int budget);
@@ -1,23 +1,33 @@
 #include <SDL3/SDL_main.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "audio.h"
+#include "breakpoints.h"
 #include "chip8.h"
 #include "debug.h"
+#include "input_queue.h"
 #include "keyboard.h"
+#include "movie.h"
+#include "profile.h"
+#include "quirks.h"
+#include "scheduler.h"
+#include "state.h"
+#include "triple_buffer.h"
 #include "video.h"
 
-#define TARGET_FPS 60
-#define FRAME_TIME_MS (1000 / TARGET_FPS)
+#define DEFAULT_CPU_HZ 800
+#define MAX_CPU_HZ 10000000
+#define CPU_HZ_STEP SCHEDULER_FRAME_HZ  // One more or less instruction per frame
 
-#define CPU_HZ 800
-#define INSTRUCTIONS_PER_FRAME (CPU_HZ / TARGET_FPS)
+#define DEFAULT_TURBO_SKIP 8  // In turbo, present every 8th frame
 
-#define TIMER_HZ 60
-#define TIMER_INTERVAL_MS (1000 / TIMER_HZ)
+#define REWIND_FRAMES (SCHEDULER_FRAME_HZ * 10)
+#define REWIND_KEYFRAME_INTERVAL SCHEDULER_FRAME_HZ
 
 typedef enum {
     RUNNING,
@@ -26,23 +36,92 @@ typedef enum {
 } exec_mode_t;
 static exec_mode_t exec_mode = RUNNING;
 
+// Input forwarded from the render thread to the emulation thread
+typedef enum {
+    INPUT_KEY_UP,      // CHIP-8 key in `value` released
+    INPUT_KEY_DOWN,    // CHIP-8 key in `value` pressed
+    INPUT_PAUSE,       // Toggle between running and paused
+    INPUT_STEP,        // Run one instruction while paused
+    INPUT_REWIND,      // Rewinding while `value` is set
+    INPUT_STATE_KEY,   // Save state key in `value` pressed
+    INPUT_DEBUG_KEY,   // Debugger key in `value` pressed
+    INPUT_TURBO,       // Running uncapped while `value` is set
+    INPUT_CPU_HZ,      // Clock one step faster if `value` is set, slower otherwise
+    INPUT_BREAKPOINT,  // Toggle a breakpoint at the program counter
+} input_type_t;
+
 static bool is_debug = false;
+static bool is_profile = false;
+static bool is_seeded = false;
+static uint64_t seed = 0;
+static bool is_rewinding = false;
+static backend_t backend = BACKEND_INTERP;
+static bool is_quirks_set = false;
+static quirks_t quirks = QUIRKS_VIP;
+static const char* quirks_db = NULL;
+static uint32_t cpu_hz = DEFAULT_CPU_HZ;
+static int turbo_skip = DEFAULT_TURBO_SKIP;
+static rewind_buffer_t* rewind_buffer = NULL;
+static const char* movie_file = NULL;
+static movie_t movie = {0};
+static char state_file[1024];
+
+// Owned by the emulation thread while it runs
+static chip8_t chip8 = {0};
+static scheduler_t scheduler;
+static uint64_t frame_number = 0;
+
+static triple_buffer_t frames;
+static input_queue_t inputs;
+static atomic_bool is_running;
 
 void cleanup(void);
+bool parse_stop_option(const char* option, chip8_t* cpu);
+void save_recording(const chip8_t* cpu);
+void handle_state_key(SDL_Scancode scancode, chip8_t* cpu, const char* state_file);
+void handle_input(input_event_t input, chip8_t* cpu);
+void push_input(input_type_t type, uint16_t value);
+void end_frame(chip8_t* cpu, bool is_presented);
+int run_emulator(void* data);
 
 int main(int argc, char* argv[]) {
-    // Check for debug flag
-    // TODO: Improve argument parsing
-    if (argc > 2 && strcmp(argv[2], "--debug") == 0) {
-        is_debug = true;
-    }
-
     // Check if a ROM file was provided
     if (argc < 2) {
-        printf("Usage: %s <ROM> [--debug]\n", argv[0]);
+        printf("Usage: %s <ROM> [--debug] [--backend=interp|threaded|jit] [--record=FILE] [--profile] [--seed=N] [--cpu-hz=N|--ipf=N] [--turbo=K] [--quirks=vip|chip48|schip|xochip] [--quirks-db=FILE] [--break=ADDR] [--watch=ADDR[:SIZE][:r|w|rw]] [--break-if=COND]\n", argv[0]);
         return EXIT_FAILURE;
     }
 
+    // Parse options following the ROM
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--debug") == 0) {
+            is_debug = true;
+        } else if (strncmp(argv[i], "--backend=", 10) == 0 && parse_backend(argv[i] + 10, &backend)) {
+            continue;
+        } else if (strncmp(argv[i], "--seed=", 7) == 0 && argv[i][7]) {
+            seed = strtoull(argv[i] + 7, NULL, 0);
+            is_seeded = true;
+        } else if (strncmp(argv[i], "--cpu-hz=", 9) == 0 && atoi(argv[i] + 9) > 0 && atoi(argv[i] + 9) <= MAX_CPU_HZ) {
+            cpu_hz = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--ipf=", 6) == 0 && atoi(argv[i] + 6) > 0 && atoi(argv[i] + 6) <= MAX_CPU_HZ / SCHEDULER_FRAME_HZ) {
+            cpu_hz = atoi(argv[i] + 6) * SCHEDULER_FRAME_HZ;
+        } else if (strncmp(argv[i], "--turbo=", 8) == 0 && atoi(argv[i] + 8) > 0) {
+            turbo_skip = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--quirks=", 9) == 0 && parse_quirks(argv[i] + 9, &quirks)) {
+            is_quirks_set = true;
+        } else if (strncmp(argv[i], "--quirks-db=", 12) == 0 && argv[i][12]) {
+            quirks_db = argv[i] + 12;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            is_profile = true;
+        } else if (strncmp(argv[i], "--record=", 9) == 0 && argv[i][9]) {
+            movie_file = argv[i] + 9;
+        } else if (parse_stop_option(argv[i], &chip8)) {
+            is_debug = true;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
     // Initialize video and audio
     if (!video_init() || !audio_init()) {
         cleanup();
@@ -50,7 +129,6 @@ int main(int argc, char* argv[]) {
     }
 
     // Initialize CPU
-    chip8_t chip8 = {0};
     init_chip8(&chip8);
 
     // Try loading the ROM
@@ -60,74 +138,326 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    uint64_t last_frame_update = SDL_GetTicks();
-    uint64_t last_timer_update = SDL_GetTicks();
+    // A profile given on the command line wins over the database, VIP otherwise
+    if (!is_quirks_set && quirks_db) {
+        find_rom_quirks(quirks_db, argv[1], &quirks);
+    }
+    set_chip8_quirks(&chip8, quirks);
+
+    if (is_profile && !(chip8.profile = profile_create())) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to allocate the profiler");
+        cleanup();
+        return EXIT_FAILURE;
+    }
+
+    // Seed CXNN from the clock unless given, recordings keep the seed so they replay bit for bit
+    if (!is_seeded) {
+        seed = time(NULL);
+    }
+    seed_chip8(&chip8, seed);
+    if (movie_file) {
+        init_movie(&movie, &chip8, seed);
+    }
+
+    // Quick save slot next to the ROM
+    snprintf(state_file, sizeof(state_file), "%s.state", argv[1]);
+
+    rewind_buffer = rewind_create(REWIND_FRAMES, REWIND_KEYFRAME_INTERVAL);
+    if (!rewind_buffer) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to allocate the rewind buffer");
+        cleanup();
+        return EXIT_FAILURE;
+    }
 
-    while (true) {
-        uint64_t current_time = SDL_GetTicks();
+    // Emulate on a thread of its own, so a slow present or a vsync stall can't delay it
+    triple_buffer_init(&frames);
+    input_queue_init(&inputs);
+    atomic_store(&is_running, true);
+    SDL_Thread* emulator = SDL_CreateThread(run_emulator, "chip8", NULL);
+    if (!emulator) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to create emulation thread: %s", SDL_GetError());
+        cleanup_chip8(&chip8);
+        cleanup();
+        return EXIT_FAILURE;
+    }
 
+    bool is_ok = true;
+    while (is_ok) {
         // Handle events
+        bool is_quit = false;
+        bool is_exposed = false;
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_EVENT_QUIT || (event.type == SDL_EVENT_KEY_DOWN && event.key.scancode == SDL_SCANCODE_ESCAPE)) {
-                cleanup();
-                return EXIT_SUCCESS;
+                is_quit = true;
+            }
+            if (event.type == SDL_EVENT_WINDOW_EXPOSED || event.type == SDL_EVENT_WINDOW_RESIZED || event.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED) {
+                video_expose();
+                is_exposed = true;
             }
+            if (event.type != SDL_EVENT_KEY_DOWN && event.type != SDL_EVENT_KEY_UP) {
+                continue;
+            }
+            bool is_key_down = event.type == SDL_EVENT_KEY_DOWN;
+            SDL_Scancode scancode = event.key.scancode;
 
             // Emulator controls
-            if (is_debug && event.type == SDL_EVENT_KEY_DOWN) {
-                if (event.key.scancode == SDL_SCANCODE_P) {
-                    exec_mode = exec_mode == RUNNING ? PAUSED : RUNNING;
+            if (is_debug && is_key_down) {
+                if (scancode == SDL_SCANCODE_P) {
+                    push_input(INPUT_PAUSE, 0);
+                }
+                if (scancode == SDL_SCANCODE_N) {
+                    push_input(INPUT_STEP, 0);
                 }
-                if (event.key.scancode == SDL_SCANCODE_N && exec_mode == PAUSED) {
-                    exec_mode = STEP_ONCE;
+                if (scancode == SDL_SCANCODE_B) {
+                    push_input(INPUT_BREAKPOINT, 0);
                 }
+                push_input(INPUT_DEBUG_KEY, scancode);
             }
 
-            if (event.type == SDL_EVENT_KEY_DOWN || event.type == SDL_EVENT_KEY_UP) {
-                handle_key_event(&event, &chip8);
-                if (is_debug) debug_handle_key_event(&event, &chip8);
+            // Hold Tab to run uncapped, F2 and F3 slow down and speed up the clock
+            if (scancode == SDL_SCANCODE_TAB && !event.key.repeat) {
+                push_input(INPUT_TURBO, is_key_down);
+            }
+            if (is_key_down && (scancode == SDL_SCANCODE_F2 || scancode == SDL_SCANCODE_F3)) {
+                push_input(INPUT_CPU_HZ, scancode == SDL_SCANCODE_F3);
             }
+
+            // Save states and rewind, jumping around in time would break a recording
+            if (!movie_file) {
+                if (scancode == SDL_SCANCODE_BACKSPACE && !event.key.repeat) {
+                    push_input(INPUT_REWIND, is_key_down);
+                }
+                if (is_key_down && !event.key.repeat) {
+                    push_input(INPUT_STATE_KEY, scancode);
+                }
+            }
+
+            int key = get_chip8_key(scancode);
+            if (key >= 0 && !event.key.repeat) {
+                push_input(is_key_down ? INPUT_KEY_DOWN : INPUT_KEY_UP, key);
+            }
+        }
+        if (is_quit) {
+            break;
         }
 
-        // Execute instructions for the current frame
-        for (int i = 0; i < INSTRUCTIONS_PER_FRAME; i++) {
-            if (exec_mode == PAUSED) break;
+        // Present the latest emulated frame, `video_update` skips the present when the display didn't change,
+        // unless the window needs redrawing
+        bool is_new;
+        const frame_t* frame = triple_buffer_front(&frames, &is_new);
+        if (!is_new && !is_exposed) {
+            SDL_Delay(1);
+            continue;
+        }
+        is_ok = video_update(frame);
+    }
+
+    // The machine is back to this thread once the emulation thread is done
+    atomic_store(&is_running, false);
+    SDL_WaitThread(emulator, NULL);
+
+    save_recording(&chip8);
+    if (is_ok && chip8.profile) print_profile(chip8.profile, &chip8, stdout);
+    cleanup_chip8(&chip8);
+    cleanup();
+    return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int run_emulator(void* data) {
+    scheduler_init(&scheduler, cpu_hz, turbo_skip, SDL_GetTicksNS());
 
-            step_chip8(&chip8);
-            if (exec_mode == STEP_ONCE) exec_mode = PAUSED;
+    while (atomic_load(&is_running)) {
+        // Apply input that arrived since the last frame
+        input_event_t input;
+        while (input_queue_pop(&inputs, &input)) {
+            handle_input(input, &chip8);
         }
 
-        // Update timers if needed
-        if (current_time - last_timer_update >= TIMER_INTERVAL_MS) {
+        // Execute instructions and tick the timers for the current frame, or step back one frame while rewinding
+        int budget = scheduler_frame_budget(&scheduler);
+        if (is_rewinding) {
+            bool keyboard[KEYBOARD_SIZE];
+            memcpy(keyboard, chip8.keyboard, sizeof(keyboard));
+            if (rewind_restore(rewind_buffer, &chip8, 1)) {
+                chip8.is_redraw_needed = true;
+            }
+            memcpy(chip8.keyboard, keyboard, sizeof(keyboard));  // Keep the keys that are held right now
+        } else if (exec_mode == RUNNING) {
+            run_chip8(&chip8, backend, budget);
             step_chip8_timer(&chip8);
-            last_timer_update = current_time;
+            if (movie_file) {
+                record_movie_event(&movie, &chip8, MOVIE_TIMER, 0);
+            }
+            rewind_push(rewind_buffer, &chip8);
+        } else if (exec_mode == STEP_ONCE) {
+            run_chip8(&chip8, BACKEND_INTERP, 1);
+            exec_mode = PAUSED;
         }
 
-        // Update debugger if needed
-        if (is_debug) {
-            debug_update(&chip8);
+        // Pause where a breakpoint, watchpoint or condition stopped the run
+        if (chip8.breakpoints && chip8.breakpoints->is_stopped) {
+            chip8.breakpoints->is_stopped = false;
+            exec_mode = PAUSED;
         }
 
-        // Try updating video and audio
-        if (!video_update(&chip8) || !audio_update(&chip8)) {
-            cleanup();
-            return EXIT_FAILURE;
+        // Wait for the next frame, unless running uncapped
+        uint64_t wait_ns;
+        bool is_presented = scheduler_end_frame(&scheduler, SDL_GetTicksNS(), &wait_ns);
+        end_frame(&chip8, is_presented);
+        if (wait_ns) {
+            SDL_DelayPrecise(wait_ns);
+        }
+    }
+    return 0;
+}
+
+// Ends the frame with the vblank DXYN waits for, and hands it to the render thread if presented
+void end_frame(chip8_t* cpu, bool is_presented) {
+    cpu->is_redraw_needed = false;
+    if (movie_file) {
+        record_movie_event(&movie, cpu, MOVIE_VBLANK, 0);
+    }
+    if (cpu->profile) {
+        profile_frame(cpu->profile);
+    }
+    audio_update(cpu);  // Every frame, so the sound follows the timer even when frames aren't presented
+    if (!is_presented) {
+        return;
+    }
+
+    // Update debugger if needed
+    if (is_debug) {
+        debug_update(cpu);
+    }
+
+    frame_t* frame = triple_buffer_back(&frames);
+    memcpy(frame->display, cpu->display, sizeof(frame->display));
+    frame->is_hires = cpu->is_hires;
+    frame->dirty_rows = cpu->dirty_rows;
+    frame->frame_number = ++frame_number;
+    cpu->dirty_rows = 0;  // Rows of frames that aren't presented carry over to the next one
+    triple_buffer_publish(&frames);
+}
+
+void push_input(input_type_t type, uint16_t value) {
+    if (!input_queue_push(&inputs, (input_event_t){type, value})) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Input queue full, dropped input");
+    }
+}
+
+void handle_input(input_event_t input, chip8_t* cpu) {
+    switch (input.type) {
+        case INPUT_KEY_UP:
+        case INPUT_KEY_DOWN: {
+            bool is_key_down = input.type == INPUT_KEY_DOWN;
+            if (cpu->keyboard[input.value] == is_key_down) {
+                break;
+            }
+            cpu->keyboard[input.value] = is_key_down;
+            if (movie_file) {
+                record_movie_event(&movie, cpu, is_key_down ? MOVIE_KEY_DOWN : MOVIE_KEY_UP, input.value);
+            }
+            break;
         }
+        case INPUT_PAUSE:
+            exec_mode = exec_mode == RUNNING ? PAUSED : RUNNING;
+            if (exec_mode == RUNNING && cpu->breakpoints) {
+                cpu->breakpoints->is_resuming = true;
+            }
+            break;
+        case INPUT_STEP:
+            if (exec_mode == PAUSED) {
+                exec_mode = STEP_ONCE;
+                if (cpu->breakpoints) {
+                    cpu->breakpoints->is_resuming = true;
+                }
+            }
+            break;
+        case INPUT_BREAKPOINT:
+            if (!cpu->breakpoints) {
+                cpu->breakpoints = breakpoints_create();
+            }
+            if (cpu->breakpoints && !remove_breakpoint(cpu->breakpoints, cpu->pc) && !add_breakpoint(cpu->breakpoints, cpu->pc)) {
+                SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Too many breakpoints, at most %d", BREAKPOINTS_MAX);
+            }
+            break;
+        case INPUT_REWIND:
+            is_rewinding = input.value;
+            break;
+        case INPUT_STATE_KEY:
+            handle_state_key(input.value, cpu, state_file);
+            break;
+        case INPUT_DEBUG_KEY:
+            debug_handle_key(input.value);
+            break;
+        case INPUT_TURBO:
+            scheduler_set_turbo(&scheduler, input.value, SDL_GetTicksNS());
+            break;
+        case INPUT_CPU_HZ:
+            if (input.value && scheduler.cpu_hz + CPU_HZ_STEP <= MAX_CPU_HZ) {
+                scheduler_set_cpu_hz(&scheduler, scheduler.cpu_hz + CPU_HZ_STEP);
+            } else if (!input.value && scheduler.cpu_hz > CPU_HZ_STEP) {
+                scheduler_set_cpu_hz(&scheduler, scheduler.cpu_hz - CPU_HZ_STEP);
+            }
+            SDL_Log("CPU clock: %u Hz", scheduler.cpu_hz);
+            break;
+    }
+}
 
-        // Wait for the next frame if the current frame completed too quickly
-        uint64_t current_frame_time = current_time - last_frame_update;
-        if (current_frame_time < FRAME_TIME_MS) {
-            SDL_Delay(FRAME_TIME_MS - current_frame_time);
+// Adds the breakpoint, watchpoint or condition of a `--break`, `--watch` or `--break-if` option
+bool parse_stop_option(const char* option, chip8_t* cpu) {
+    bool is_break = strncmp(option, "--break=", 8) == 0;
+    bool is_watch = strncmp(option, "--watch=", 8) == 0;
+    bool is_condition = strncmp(option, "--break-if=", 11) == 0;
+    if (!is_break && !is_watch && !is_condition) {
+        return false;
+    }
+    if (!cpu->breakpoints && !(cpu->breakpoints = breakpoints_create())) {
+        return false;
+    }
+
+    if (is_break) {
+        char* end;
+        unsigned long address = strtoul(option + 8, &end, 0);
+        return end != option + 8 && *end == '\0' && address < MEMORY_SIZE && add_breakpoint(cpu->breakpoints, address);
+    }
+    if (is_watch) {
+        watchpoint_t watchpoint;
+        return parse_watchpoint(option + 8, &watchpoint) && add_watchpoint(cpu->breakpoints, watchpoint);
+    }
+    condition_t condition;
+    return parse_condition(option + 11, &condition) && add_condition(cpu->breakpoints, condition);
+}
+
+void handle_state_key(SDL_Scancode scancode, chip8_t* cpu, const char* state_file) {
+    if (scancode == SDL_SCANCODE_F5 && !save_chip8_state_file(cpu, state_file)) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to save state: %s", state_file);
+    }
+    if (scancode == SDL_SCANCODE_F9) {
+        bool keyboard[KEYBOARD_SIZE];
+        memcpy(keyboard, cpu->keyboard, sizeof(keyboard));
+        if (!load_chip8_state_file(cpu, state_file)) {
+            SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to load state: %s", state_file);
         }
-        last_frame_update = SDL_GetTicks();
+        memcpy(cpu->keyboard, keyboard, sizeof(keyboard));
+        cpu->is_redraw_needed = true;
     }
+}
 
-    cleanup();
-    return EXIT_SUCCESS;
+void save_recording(const chip8_t* cpu) {
+    if (!movie_file) {
+        return;
+    }
+    if (!finish_movie(&movie, cpu) || !save_movie(&movie, movie_file)) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to save recording: %s", movie_file);
+    }
+    cleanup_movie(&movie);
 }
 
 void cleanup(void) {
+    rewind_destroy(rewind_buffer);
+    rewind_buffer = NULL;
     video_cleanup();
     audio_cleanup();
     SDL_Quit();
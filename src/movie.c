@@ -0,0 +1,232 @@
+#include "movie.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "state.h"
+
+#define MOVIE_FILE_MAGIC "CH8M"
+#define MOVIE_REPLAY_CHUNK (1 << 20)  // Instructions per `run_chip8` call between events
+
+// FNV-1a
+static uint32_t hash_bytes(uint32_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t hash_chip8_state(const chip8_t* cpu) {
+    chip8_state_t state;
+    save_chip8_state(cpu, &state);
+    return hash_bytes(2166136261u, &state, sizeof(state));
+}
+
+uint32_t hash_chip8_memory(const chip8_t* cpu) {
+    return hash_bytes(2166136261u, cpu->memory, sizeof(cpu->memory));
+}
+
+void init_movie(movie_t* movie, const chip8_t* cpu, uint64_t seed) {
+    *movie = (movie_t){
+        .seed = seed,
+        .quirks = cpu->quirks,
+        .memory_hash = hash_chip8_memory(cpu),
+    };
+}
+
+void cleanup_movie(movie_t* movie) {
+    free(movie->events);
+    *movie = (movie_t){0};
+}
+
+static bool push_event(movie_t* movie, movie_event_t event) {
+    if (movie->count == movie->capacity) {
+        size_t capacity = movie->capacity ? movie->capacity * 2 : 1024;
+        movie_event_t* events = realloc(movie->events, capacity * sizeof(movie_event_t));
+        if (!events) {
+            return false;
+        }
+        movie->events = events;
+        movie->capacity = capacity;
+    }
+    movie->events[movie->count++] = event;
+    return true;
+}
+
+bool record_movie_event(movie_t* movie, const chip8_t* cpu, movie_event_type_t type, uint8_t key) {
+    return push_event(movie, (movie_event_t){cpu->instruction_count, type, key});
+}
+
+bool finish_movie(movie_t* movie, const chip8_t* cpu) {
+    movie->final_hash = hash_chip8_state(cpu);
+    return record_movie_event(movie, cpu, MOVIE_END, 0);
+}
+
+static void write_u32(FILE* file, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        fputc((value >> (i * 8)) & 0xFF, file);
+    }
+}
+
+static void write_u64(FILE* file, uint64_t value) {
+    write_u32(file, value & 0xFFFFFFFF);
+    write_u32(file, value >> 32);
+}
+
+static void write_varint(FILE* file, uint64_t value) {
+    while (value >= 0x80) {
+        fputc((value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc(value, file);
+}
+
+static bool read_u32(FILE* file, uint32_t* value) {
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        int byte = fgetc(file);
+        if (byte == EOF) {
+            return false;
+        }
+        *value |= (uint32_t)byte << (i * 8);
+    }
+    return true;
+}
+
+static bool read_u64(FILE* file, uint64_t* value) {
+    uint32_t low, high;
+    if (!read_u32(file, &low) || !read_u32(file, &high)) {
+        return false;
+    }
+    *value = ((uint64_t)high << 32) | low;
+    return true;
+}
+
+static bool read_varint(FILE* file, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF) {
+            return false;
+        }
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool save_movie(const movie_t* movie, const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        return false;
+    }
+
+    fwrite(MOVIE_FILE_MAGIC, 1, 4, file);
+    write_u32(file, MOVIE_FILE_VERSION);
+    write_u64(file, movie->seed);
+    write_u32(file, movie->quirks);
+    write_u32(file, movie->memory_hash);
+    write_u32(file, movie->final_hash);
+    write_u32(file, movie->count);
+
+    // Events are the instruction delta to the previous event, then the type and key in one byte
+    uint64_t instruction_count = 0;
+    for (size_t i = 0; i < movie->count; i++) {
+        const movie_event_t* event = &movie->events[i];
+        write_varint(file, event->instruction_count - instruction_count);
+        fputc((event->type << 4) | (event->key & 0xF), file);
+        instruction_count = event->instruction_count;
+    }
+
+    bool is_written = !ferror(file);
+    return fclose(file) == 0 && is_written;
+}
+
+bool load_movie(movie_t* movie, const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return false;
+    }
+
+    *movie = (movie_t){0};
+    char magic[4];
+    uint32_t version, count;
+    bool is_ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, MOVIE_FILE_MAGIC, 4) == 0 &&
+                 read_u32(file, &version) && version == MOVIE_FILE_VERSION &&
+                 read_u64(file, &movie->seed) &&
+                 read_u32(file, &movie->quirks) && movie->quirks < QUIRKS_COUNT &&
+                 read_u32(file, &movie->memory_hash) &&
+                 read_u32(file, &movie->final_hash) &&
+                 read_u32(file, &count);
+
+    uint64_t instruction_count = 0;
+    for (uint32_t i = 0; is_ok && i < count; i++) {
+        uint64_t delta;
+        int byte;
+        is_ok = read_varint(file, &delta) && (byte = fgetc(file)) != EOF && (byte >> 4) <= MOVIE_END;
+        if (is_ok) {
+            instruction_count += delta;
+            is_ok = push_event(movie, (movie_event_t){instruction_count, byte >> 4, byte & 0xF});
+        }
+    }
+    fclose(file);
+
+    if (!is_ok) {
+        cleanup_movie(movie);
+    }
+    return is_ok;
+}
+
+// Returns the version a movie was recorded with, 0 if the file isn't a movie
+uint32_t read_movie_version(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    char magic[4];
+    uint32_t version;
+    bool is_ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, MOVIE_FILE_MAGIC, 4) == 0 && read_u32(file, &version);
+    fclose(file);
+    return is_ok ? version : 0;
+}
+
+void apply_movie_event(chip8_t* cpu, const movie_event_t* event) {
+    switch (event->type) {
+        case MOVIE_KEY_UP:
+        case MOVIE_KEY_DOWN:
+            cpu->keyboard[event->key] = event->type == MOVIE_KEY_DOWN;
+            break;
+        case MOVIE_TIMER:
+            step_chip8_timer(cpu);
+            break;
+        case MOVIE_VBLANK:
+            cpu->is_redraw_needed = false;
+            break;
+        case MOVIE_END:
+            break;
+    }
+}
+
+bool replay_movie(chip8_t* cpu, const movie_t* movie, backend_t backend) {
+    if (hash_chip8_memory(cpu) != movie->memory_hash) {
+        return false;
+    }
+    seed_chip8(cpu, movie->seed);
+    set_chip8_quirks(cpu, movie->quirks);
+
+    // Run uncapped up to each event, then apply it exactly where it was recorded
+    for (size_t i = 0; i < movie->count; i++) {
+        const movie_event_t* event = &movie->events[i];
+        while (cpu->instruction_count < event->instruction_count) {
+            uint64_t remaining = event->instruction_count - cpu->instruction_count;
+            run_chip8(cpu, backend, remaining < MOVIE_REPLAY_CHUNK ? remaining : MOVIE_REPLAY_CHUNK);
+        }
+        apply_movie_event(cpu, event);
+    }
+    return hash_chip8_state(cpu) == movie->final_hash;
+}
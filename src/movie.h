@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+#define MOVIE_FILE_VERSION 4
+
+typedef enum {
+    MOVIE_KEY_UP,    // Key in `key` released
+    MOVIE_KEY_DOWN,  // Key in `key` pressed
+    MOVIE_TIMER,     // Delay and sound timers ticked
+    MOVIE_VBLANK,    // Display presented, DXYN may draw again
+    MOVIE_END,       // End of the recording, the final state hash follows
+} movie_event_type_t;
+
+typedef struct {
+    uint64_t instruction_count;  // Instructions run before the event took effect
+    uint8_t type;
+    uint8_t key;
+} movie_event_t;
+
+typedef struct {
+    uint64_t seed;          // Passed to `seed_chip8` before the first instruction
+    uint32_t quirks;        // `quirks_t` of the recording, passed to `set_chip8_quirks`
+    uint32_t memory_hash;   // Memory after loading the ROM, to catch replays against another ROM
+    uint32_t final_hash;    // State at the end of the recording
+    movie_event_t* events;
+    size_t count;
+    size_t capacity;
+} movie_t;
+
+uint32_t hash_chip8_state(const chip8_t* cpu);
+uint32_t hash_chip8_memory(const chip8_t* cpu);
+
+void init_movie(movie_t* movie, const chip8_t* cpu, uint64_t seed);
+void cleanup_movie(movie_t* movie);
+bool record_movie_event(movie_t* movie, const chip8_t* cpu, movie_event_type_t type, uint8_t key);
+bool finish_movie(movie_t* movie, const chip8_t* cpu);
+bool save_movie(const movie_t* movie, const char* filename);
+bool load_movie(movie_t* movie, const char* filename);
+uint32_t read_movie_version(const char* filename);
+void apply_movie_event(chip8_t* cpu, const movie_event_t* event);
+bool replay_movie(chip8_t* cpu, const movie_t* movie, backend_t backend);
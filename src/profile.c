@@ -0,0 +1,122 @@
+#include "profile.h"
+
+#include <stdlib.h>
+
+#include "chip8.h"
+
+profile_t* profile_create(void) {
+    return calloc(1, sizeof(profile_t));
+}
+
+void profile_destroy(profile_t* profile) {
+    free(profile);
+}
+
+void profile_step(chip8_t* cpu) {
+    profile_t* profile = cpu->profile;
+    uint16_t pc = cpu->pc;
+    uint8_t op = fetch_instruction(cpu, pc)->op;
+
+    step_chip8(cpu);
+
+    profile->instructions++;
+    profile->op_counts[op]++;
+    profile->address_counts[pc & (MEMORY_SIZE - 1)]++;
+
+    // Both ops wait by leaving the program counter on themselves
+    if (cpu->pc == pc && op == OP_DXYN) {
+        profile->dxyn_waits++;
+    } else if (cpu->pc == pc && op == OP_FX0A) {
+        profile->fx0a_waits++;
+    } else {
+        profile->frame_retired++;
+    }
+}
+
+void profile_frame(profile_t* profile) {
+    profile->frame_history[profile->frames % PROFILE_FRAME_HISTORY] = profile->frame_retired;
+    profile->frame_retired = 0;
+    profile->frames++;
+}
+
+int get_profile_top_addresses(const profile_t* profile, uint16_t* addresses, int count) {
+    // Insertion into a short sorted list, `count` is small
+    int found = 0;
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        uint64_t executions = profile->address_counts[address];
+        if (!executions || (found == count && executions <= profile->address_counts[addresses[found - 1]])) {
+            continue;
+        }
+
+        int i = found < count ? found++ : count - 1;
+        while (i > 0 && profile->address_counts[addresses[i - 1]] < executions) {
+            addresses[i] = addresses[i - 1];
+            i--;
+        }
+        addresses[i] = address;
+    }
+    return found;
+}
+
+void get_profile_frame_stats(const profile_t* profile, uint32_t* min, uint32_t* max, double* average) {
+    int count = profile->frames < PROFILE_FRAME_HISTORY ? profile->frames : PROFILE_FRAME_HISTORY;
+    uint64_t sum = 0;
+    *min = count ? UINT32_MAX : 0;
+    *max = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t retired = profile->frame_history[i];
+        sum += retired;
+        *min = retired < *min ? retired : *min;
+        *max = retired > *max ? retired : *max;
+    }
+    *average = count ? (double)sum / count : 0;
+}
+
+static double get_share(uint64_t part, uint64_t total) {
+    return total ? 100.0 * part / total : 0;
+}
+
+void print_profile(const profile_t* profile, const chip8_t* cpu, FILE* out) {
+    uint64_t total = profile->instructions;
+    fprintf(out, "profile: %llu instructions, %llu frames\n", (unsigned long long)total, (unsigned long long)profile->frames);
+    fprintf(out, "  DXYN vblank waits:   %llu (%.1f%%)\n", (unsigned long long)profile->dxyn_waits,
+            get_share(profile->dxyn_waits, total));
+    fprintf(out, "  FX0A key waits:      %llu (%.1f%%)\n", (unsigned long long)profile->fx0a_waits,
+            get_share(profile->fx0a_waits, total));
+    fprintf(out, "  idle slots:          %llu (%.1f%% of all slots)\n", (unsigned long long)profile->idle,
+            get_share(profile->idle, total + profile->idle));
+
+    uint32_t min, max;
+    double average;
+    get_profile_frame_stats(profile, &min, &max, &average);
+    fprintf(out, "  retired per frame:   %.1f average, %u min, %u max over the last %d frames\n", average, min, max,
+            profile->frames < PROFILE_FRAME_HISTORY ? (int)profile->frames : PROFILE_FRAME_HISTORY);
+
+    // Ops by execution count, most executed first
+    bool is_printed[OP_COUNT] = {false};
+    fprintf(out, "  ops:\n");
+    for (int rank = 0; rank < OP_COUNT; rank++) {
+        int top = -1;
+        for (int op = 0; op < OP_COUNT; op++) {
+            if (!is_printed[op] && profile->op_counts[op] && (top < 0 || profile->op_counts[op] > profile->op_counts[top])) {
+                top = op;
+            }
+        }
+        if (top < 0) {
+            break;
+        }
+        is_printed[top] = true;
+        fprintf(out, "    %-7s %14llu %6.1f%%\n", OP_NAMES[top], (unsigned long long)profile->op_counts[top],
+                get_share(profile->op_counts[top], total));
+    }
+
+    uint16_t addresses[PROFILE_TOP_ADDRESSES];
+    int count = get_profile_top_addresses(profile, addresses, PROFILE_TOP_ADDRESSES);
+    fprintf(out, "  hottest addresses:\n");
+    for (int i = 0; i < count; i++) {
+        uint16_t address = addresses[i];
+        uint16_t opcode = (cpu->memory[address] << 8) | cpu->memory[(address + 1) & (MEMORY_SIZE - 1)];
+        fprintf(out, "    0x%03X %04X %14llu %6.1f%%\n", address, opcode, (unsigned long long)profile->address_counts[address],
+                get_share(profile->address_counts[address], total));
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "chip8_t.h"
+#include "instructions.h"
+
+#define PROFILE_FRAME_HISTORY 128
+#define PROFILE_TOP_ADDRESSES 8
+
+struct profile {
+    uint64_t instructions;                 // Everything executed, waiting instructions included
+    uint64_t op_counts[OP_COUNT];          // Executions per op
+    uint64_t address_counts[MEMORY_SIZE];  // Executions per instruction address
+    uint64_t dxyn_waits;                   // DXYN executed without drawing, waiting for the vblank
+    uint64_t fx0a_waits;                   // FX0A executed without finishing, waiting for a key press or release
+    uint64_t idle;                         // Instruction slots slept through while waiting
+
+    uint64_t frames;
+    uint32_t frame_retired;                         // Instructions retired so far in the current frame
+    uint32_t frame_history[PROFILE_FRAME_HISTORY];  // Instructions retired in the last frames
+};
+
+profile_t* profile_create(void);
+void profile_destroy(profile_t* profile);
+void profile_step(chip8_t* cpu);
+void profile_frame(profile_t* profile);
+int get_profile_top_addresses(const profile_t* profile, uint16_t* addresses, int count);
+void get_profile_frame_stats(const profile_t* profile, uint32_t* min, uint32_t* max, double* average);
+void print_profile(const profile_t* profile, const chip8_t* cpu, FILE* out);
@@ -0,0 +1,60 @@
+#include "quirks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUIRK_PROFILE_ENTRY(id, name, vf_reset, memory, shift_vy, clipped, display_wait, jump_vx, big_sprite) \
+    [QUIRKS_##id] = {name, vf_reset, memory, shift_vy, clipped, display_wait, jump_vx, big_sprite},
+
+const quirk_profile_t QUIRK_PROFILES[QUIRKS_COUNT] = {FOR_EACH_QUIRK_PROFILE(QUIRK_PROFILE_ENTRY)};
+
+bool parse_quirks(const char* name, quirks_t* quirks) {
+    for (int i = 0; i < QUIRKS_COUNT; i++) {
+        if (strcmp(name, QUIRK_PROFILES[i].name) == 0) {
+            *quirks = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// FNV-1a of the ROM file, the key of the database
+uint32_t hash_rom(const uint8_t* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Look the ROM up in a database of `<hash> <profile>` lines, in hex and by name, `#` starts a comment
+bool find_rom_quirks(const char* database, const char* rom, quirks_t* quirks) {
+    static uint8_t data[MEMORY_SIZE - PC_START_ADDR];  // As much as `load_rom` reads
+    FILE* file = fopen(rom, "rb");
+    if (!file) {
+        return false;
+    }
+    size_t size = fread(data, sizeof(uint8_t), sizeof(data), file);
+    fclose(file);
+
+    file = fopen(database, "r");
+    if (!file) {
+        return false;
+    }
+
+    uint32_t hash = hash_rom(data, size);
+    char line[256];
+    bool is_found = false;
+    while (!is_found && fgets(line, sizeof(line), file)) {
+        char name[32];
+        char* end;
+        uint32_t key = strtoul(line, &end, 16);
+        if (end == line || line[0] == '#' || key != hash || sscanf(end, "%31s", name) != 1) {
+            continue;
+        }
+        is_found = parse_quirks(name, quirks);
+    }
+    fclose(file);
+    return is_found;
+}
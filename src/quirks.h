@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+// Force inlining, so the quirks passed as constants fold away in each specialization
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+// Where FX55 and FX65 leave I
+typedef enum {
+    MEMORY_I_UNCHANGED,      // I is left as is
+    MEMORY_I_PLUS_X,         // I ends on the last register's address
+    MEMORY_I_PLUS_X_PLUS_1,  // I ends past the last register's address
+} memory_quirk_t;
+
+// Every quirk profile, expanded into one specialized handler table each by `instructions.c`
+// Refer to https://github.com/Timendus/chip8-test-suite?tab=readme-ov-file#the-test
+//
+// id, name, 8XY1/2/3 reset VF, FX55/FX65 memory, 8XY6/8XYE shift VY, DXYN clips, DXYN waits for vblank, BNNN jumps to VX,
+// DXY0 draws a 16x16 sprite
+#define FOR_EACH_QUIRK_PROFILE(PROFILE)                                                       \
+    PROFILE(VIP, "vip", true, MEMORY_I_PLUS_X_PLUS_1, true, true, true, false, false)         \
+    PROFILE(CHIP48, "chip48", false, MEMORY_I_PLUS_X, false, true, false, true, false)        \
+    PROFILE(SCHIP, "schip", false, MEMORY_I_UNCHANGED, false, true, false, true, true)        \
+    PROFILE(XOCHIP, "xochip", false, MEMORY_I_PLUS_X_PLUS_1, true, false, false, false, true)
+
+typedef struct {
+    const char* name;      // Name given to `--quirks`
+    bool is_vf_reset;      // 8XY1, 8XY2 and 8XY3 clear VF
+    uint8_t memory;        // `memory_quirk_t` of FX55 and FX65
+    bool is_shift_vy;      // 8XY6 and 8XYE shift VY into VX, instead of VX in place
+    bool is_clipped;       // DXYN clips sprites at the display edges, instead of wrapping
+    bool is_display_wait;  // DXYN waits for the vblank before drawing
+    bool is_jump_vx;       // BNNN jumps to XNN + VX, instead of NNN + V0
+    bool is_big_sprite;    // DXY0 draws a 16x16 sprite, instead of nothing
+} quirk_profile_t;
+
+extern const quirk_profile_t QUIRK_PROFILES[QUIRKS_COUNT];
+
+bool parse_quirks(const char* name, quirks_t* quirks);
+uint32_t hash_rom(const uint8_t* data, size_t size);
+bool find_rom_quirks(const char* database, const char* rom, quirks_t* quirks);
@@ -0,0 +1,57 @@
+#include "scheduler.h"
+
+static uint64_t get_frame_time(const scheduler_t* scheduler, uint64_t frames) {
+    return scheduler->start_ns + frames * SCHEDULER_NS_PER_SECOND / SCHEDULER_FRAME_HZ;
+}
+
+static void restart_schedule(scheduler_t* scheduler, uint64_t now_ns) {
+    scheduler->start_ns = now_ns;
+    scheduler->frames = 0;
+}
+
+void scheduler_init(scheduler_t* scheduler, uint32_t cpu_hz, int turbo_skip, uint64_t now_ns) {
+    scheduler->cpu_hz = cpu_hz;
+    scheduler->cycles = 0;
+    scheduler->turbo_frames = 0;
+    scheduler->turbo_skip = turbo_skip > 0 ? turbo_skip : 1;
+    scheduler->is_turbo = false;
+    restart_schedule(scheduler, now_ns);
+}
+
+void scheduler_set_cpu_hz(scheduler_t* scheduler, uint32_t cpu_hz) {
+    scheduler->cpu_hz = cpu_hz;
+    scheduler->cycles = 0;
+}
+
+void scheduler_set_turbo(scheduler_t* scheduler, bool is_turbo, uint64_t now_ns) {
+    // Leaving turbo starts a new schedule, the frames run uncapped must not be waited for
+    if (scheduler->is_turbo && !is_turbo) {
+        restart_schedule(scheduler, now_ns);
+    }
+    scheduler->is_turbo = is_turbo;
+}
+
+// Instructions to run in the next frame
+int scheduler_frame_budget(scheduler_t* scheduler) {
+    uint64_t cycles = (uint64_t)scheduler->cycles + scheduler->cpu_hz;
+    scheduler->cycles = cycles % SCHEDULER_FRAME_HZ;
+    return cycles / SCHEDULER_FRAME_HZ;
+}
+
+// Call after every frame, returns whether to present it and sets how long to wait for the next one
+bool scheduler_end_frame(scheduler_t* scheduler, uint64_t now_ns, uint64_t* wait_ns) {
+    *wait_ns = 0;
+    if (scheduler->is_turbo) {
+        return ++scheduler->turbo_frames % scheduler->turbo_skip == 0;
+    }
+
+    scheduler->frames++;
+    uint64_t next_ns = get_frame_time(scheduler, scheduler->frames);
+    if (next_ns > now_ns) {
+        *wait_ns = next_ns - now_ns;
+    } else if (now_ns - next_ns > SCHEDULER_MAX_LAG * SCHEDULER_NS_PER_SECOND / SCHEDULER_FRAME_HZ) {
+        // Too far behind, e.g. after a stall, run at full speed from here instead of racing to catch up
+        restart_schedule(scheduler, now_ns);
+    }
+    return true;
+}
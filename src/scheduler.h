@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCHEDULER_FRAME_HZ 60  // Frames per second, the delay and sound timers tick once per frame
+#define SCHEDULER_NS_PER_SECOND 1000000000ull
+#define SCHEDULER_MAX_LAG 8  // Frames behind before the schedule restarts instead of catching up
+
+// Paces frames on a nanosecond clock, without drift: frame K is due exactly K/60 s after the start,
+// and instructions are spread over frames with the remainder carried, so any clock rate averages out exactly
+typedef struct {
+    uint32_t cpu_hz;        // Instructions per second
+    uint32_t cycles;        // Instructions owed but not yet given to a frame, in 1/60 instructions
+    uint64_t start_ns;      // Time the current schedule started
+    uint64_t frames;        // Frames run since `start_ns`
+    uint64_t turbo_frames;  // Frames run in turbo
+    int turbo_skip;         // In turbo, every Kth frame is presented
+    bool is_turbo;          // Run uncapped
+} scheduler_t;
+
+void scheduler_init(scheduler_t* scheduler, uint32_t cpu_hz, int turbo_skip, uint64_t now_ns);
+void scheduler_set_cpu_hz(scheduler_t* scheduler, uint32_t cpu_hz);
+void scheduler_set_turbo(scheduler_t* scheduler, bool is_turbo, uint64_t now_ns);
+int scheduler_frame_budget(scheduler_t* scheduler);
+bool scheduler_end_frame(scheduler_t* scheduler, uint64_t now_ns, uint64_t* wait_ns);
@@ -0,0 +1,408 @@
+#include "state.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+#define STATE_FILE_MAGIC "CH8S"
+#define STATE_FILE_HEADER_SIZE 8
+#define STATE_FILE_SIZE                                                                                  \
+    (STATE_FILE_HEADER_SIZE + MEMORY_SIZE + 2 + STACK_SIZE * 2 + 1 + REGISTERS_COUNT + 2 + 1 + 1 +       \
+     DISPLAY_PLANES * DISPLAY_HEIGHT * DISPLAY_WORDS * 8 + 1 + KEYBOARD_SIZE + 1 + 1 + 1 + 2 + 8 + 8 +      \
+     AUDIO_PATTERN_SIZE + 1 + 1 + 1 + RPL_FLAGS_COUNT + 1 + 1)
+
+// Memory is compared in blocks on load, so only code that actually changed gets decoded again
+#define INVALIDATE_BLOCK_SIZE 64
+
+// Deltas store the chunks of the state that differ from the keyframe
+#define STATE_CHUNK_SIZE 16
+#define STATE_CHUNK_COUNT ((sizeof(chip8_state_t) + STATE_CHUNK_SIZE - 1) / STATE_CHUNK_SIZE)
+#define STATE_BITMAP_SIZE ((STATE_CHUNK_COUNT + 7) / 8)
+#define STATE_DELTA_MAX_SIZE (STATE_BITMAP_SIZE + sizeof(chip8_state_t))
+
+typedef struct {
+    uint8_t* data;  // Full state for keyframes, otherwise a bitmap of changed chunks followed by those chunks
+    size_t size;
+    size_t capacity;
+    bool is_keyframe;
+} rewind_frame_t;
+
+struct rewind_buffer {
+    rewind_frame_t* frames;  // Ring buffer, one entry per pushed frame
+    int capacity;
+    int newest;  // Slot of the most recent frame
+    int count;   // Frames that can be restored
+
+    int keyframe_interval;
+    int since_keyframe;      // Frames pushed since the newest keyframe
+    chip8_state_t keyframe;  // Newest keyframe, deltas are taken against it
+    uint8_t delta[STATE_DELTA_MAX_SIZE];
+};
+
+void save_chip8_state(const chip8_t* cpu, chip8_state_t* state) {
+    // Clear the padding too, deltas compare the raw bytes
+    memset(state, 0, sizeof(chip8_state_t));
+
+    memcpy(state->memory, cpu->memory, sizeof(state->memory));
+    state->pc = cpu->pc;
+    memcpy(state->stack, cpu->stack, sizeof(state->stack));
+    state->sp = cpu->sp;
+    memcpy(state->v, cpu->v, sizeof(state->v));
+    state->i = cpu->i;
+    state->delay_timer = cpu->delay_timer;
+    state->sound_timer = cpu->sound_timer;
+    memcpy(state->audio_pattern, cpu->audio_pattern, sizeof(state->audio_pattern));
+    state->audio_pitch = cpu->audio_pitch;
+    state->is_audio_pattern = cpu->is_audio_pattern;
+    memcpy(state->display, cpu->display, sizeof(state->display));
+    state->is_hires = cpu->is_hires;
+    state->planes = cpu->planes;
+    state->is_redraw_needed = cpu->is_redraw_needed;
+    memcpy(state->keyboard, cpu->keyboard, sizeof(state->keyboard));
+    state->wait_state = cpu->wait_state;
+    state->wait_key = cpu->wait_key;
+    state->is_illegal = cpu->is_illegal;
+    state->illegal_opcode = cpu->illegal_opcode;
+    state->instruction_count = cpu->instruction_count;
+    state->random_state = cpu->random_state;
+    memcpy(state->rpl_flags, cpu->rpl_flags, sizeof(state->rpl_flags));
+    state->quirks = cpu->quirks;
+}
+
+void load_chip8_state(chip8_t* cpu, const chip8_state_t* state) {
+    // A state saved under another profile only runs the same way with its handlers
+    if (cpu->quirks != state->quirks) {
+        set_chip8_quirks(cpu, state->quirks);
+    }
+
+    for (int address = 0; address < MEMORY_SIZE; address += INVALIDATE_BLOCK_SIZE) {
+        if (memcmp(&cpu->memory[address], &state->memory[address], INVALIDATE_BLOCK_SIZE) != 0) {
+            memcpy(&cpu->memory[address], &state->memory[address], INVALIDATE_BLOCK_SIZE);
+            invalidate_chip8_cache(cpu, address, INVALIDATE_BLOCK_SIZE);
+        }
+    }
+
+    cpu->pc = state->pc;
+    memcpy(cpu->stack, state->stack, sizeof(cpu->stack));
+    cpu->sp = state->sp;
+    memcpy(cpu->v, state->v, sizeof(cpu->v));
+    cpu->i = state->i;
+    cpu->delay_timer = state->delay_timer;
+    cpu->sound_timer = state->sound_timer;
+    memcpy(cpu->audio_pattern, state->audio_pattern, sizeof(cpu->audio_pattern));
+    cpu->audio_pitch = state->audio_pitch;
+    cpu->is_audio_pattern = state->is_audio_pattern;
+    memcpy(cpu->display, state->display, sizeof(cpu->display));
+    cpu->is_hires = state->is_hires;
+    cpu->planes = state->planes;
+    cpu->dirty_rows = DISPLAY_ALL_ROWS;  // Any row may differ from the one shown
+    cpu->is_redraw_needed = state->is_redraw_needed;
+    memcpy(cpu->keyboard, state->keyboard, sizeof(cpu->keyboard));
+    cpu->wait_state = state->wait_state;
+    cpu->wait_key = state->wait_key;
+    cpu->is_illegal = state->is_illegal;
+    cpu->illegal_opcode = state->illegal_opcode;
+    cpu->instruction_count = state->instruction_count;
+    cpu->random_state = state->random_state;
+    memcpy(cpu->rpl_flags, state->rpl_flags, sizeof(cpu->rpl_flags));
+}
+
+static uint8_t* put_bytes(uint8_t* out, const void* data, size_t size) {
+    memcpy(out, data, size);
+    return out + size;
+}
+
+static uint8_t* put_u16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+    return out + 2;
+}
+
+static uint8_t* put_u64(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (value >> (i * 8)) & 0xFF;
+    }
+    return out + 8;
+}
+
+static const uint8_t* get_bytes(const uint8_t* in, void* data, size_t size) {
+    memcpy(data, in, size);
+    return in + size;
+}
+
+static const uint8_t* get_u16(const uint8_t* in, uint16_t* value) {
+    *value = in[0] | (in[1] << 8);
+    return in + 2;
+}
+
+static const uint8_t* get_u64(const uint8_t* in, uint64_t* value) {
+    *value = 0;
+    for (int i = 0; i < 8; i++) {
+        *value |= (uint64_t)in[i] << (i * 8);
+    }
+    return in + 8;
+}
+
+static const uint8_t* get_bools(const uint8_t* in, bool* values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        values[i] = in[i] != 0;
+    }
+    return in + count;
+}
+
+bool save_chip8_state_file(const chip8_t* cpu, const char* filename) {
+    chip8_state_t state;
+    save_chip8_state(cpu, &state);
+
+    // Fixed layout, little endian, independent of the host and of the struct padding
+    uint8_t buffer[STATE_FILE_SIZE];
+    uint8_t* out = put_bytes(buffer, STATE_FILE_MAGIC, 4);
+    out = put_u16(out, STATE_FILE_VERSION);
+    out = put_u16(out, 0);  // Reserved
+    out = put_bytes(out, state.memory, MEMORY_SIZE);
+    out = put_u16(out, state.pc);
+    for (int i = 0; i < STACK_SIZE; i++) {
+        out = put_u16(out, state.stack[i]);
+    }
+    *out++ = state.sp;
+    out = put_bytes(out, state.v, REGISTERS_COUNT);
+    out = put_u16(out, state.i);
+    *out++ = state.delay_timer;
+    *out++ = state.sound_timer;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+            for (int word = 0; word < DISPLAY_WORDS; word++) {
+                out = put_u64(out, state.display[plane][y][word]);
+            }
+        }
+    }
+    *out++ = state.is_redraw_needed;
+    for (int i = 0; i < KEYBOARD_SIZE; i++) {
+        *out++ = state.keyboard[i];
+    }
+    *out++ = state.wait_state;
+    *out++ = state.wait_key;
+    *out++ = state.is_illegal;
+    out = put_u16(out, state.illegal_opcode);
+    out = put_u64(out, state.instruction_count);
+    out = put_u64(out, state.random_state);
+    out = put_bytes(out, state.audio_pattern, AUDIO_PATTERN_SIZE);
+    *out++ = state.audio_pitch;
+    *out++ = state.is_audio_pattern;
+    *out++ = state.is_hires;
+    out = put_bytes(out, state.rpl_flags, RPL_FLAGS_COUNT);
+    *out++ = state.planes;
+    *out++ = state.quirks;
+
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        return false;
+    }
+    bool is_written = fwrite(buffer, 1, sizeof(buffer), file) == sizeof(buffer);
+    return fclose(file) == 0 && is_written;
+}
+
+bool load_chip8_state_file(chip8_t* cpu, const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return false;
+    }
+
+    uint8_t buffer[STATE_FILE_SIZE];
+    size_t bytes_read = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+
+    uint16_t version;
+    get_u16(buffer + 4, &version);
+    if (bytes_read != sizeof(buffer) || memcmp(buffer, STATE_FILE_MAGIC, 4) != 0 || version != STATE_FILE_VERSION) {
+        return false;
+    }
+
+    chip8_state_t state;
+    memset(&state, 0, sizeof(state));
+    const uint8_t* in = get_bytes(buffer + STATE_FILE_HEADER_SIZE, state.memory, MEMORY_SIZE);
+    in = get_u16(in, &state.pc);
+    for (int i = 0; i < STACK_SIZE; i++) {
+        in = get_u16(in, &state.stack[i]);
+    }
+    state.sp = *in++;
+    in = get_bytes(in, state.v, REGISTERS_COUNT);
+    in = get_u16(in, &state.i);
+    state.delay_timer = *in++;
+    state.sound_timer = *in++;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+            for (int word = 0; word < DISPLAY_WORDS; word++) {
+                in = get_u64(in, &state.display[plane][y][word]);
+            }
+        }
+    }
+    in = get_bools(in, &state.is_redraw_needed, 1);
+    in = get_bools(in, state.keyboard, KEYBOARD_SIZE);
+    state.wait_state = *in++;
+    state.wait_key = *in++ & (KEYBOARD_SIZE - 1);
+    in = get_bools(in, &state.is_illegal, 1);
+    in = get_u16(in, &state.illegal_opcode);
+    in = get_u64(in, &state.instruction_count);
+    in = get_u64(in, &state.random_state);
+    in = get_bytes(in, state.audio_pattern, AUDIO_PATTERN_SIZE);
+    state.audio_pitch = *in++;
+    in = get_bools(in, &state.is_audio_pattern, 1);
+    in = get_bools(in, &state.is_hires, 1);
+    in = get_bytes(in, state.rpl_flags, RPL_FLAGS_COUNT);
+    state.planes = *in++ & ((1 << DISPLAY_PLANES) - 1);
+    state.quirks = *in;
+    if (state.quirks >= QUIRKS_COUNT) {
+        return false;
+    }
+
+    load_chip8_state(cpu, &state);
+    return true;
+}
+
+static size_t encode_delta(const chip8_state_t* keyframe, const chip8_state_t* state, uint8_t* out) {
+    const uint8_t* base = (const uint8_t*)keyframe;
+    const uint8_t* bytes = (const uint8_t*)state;
+
+    memset(out, 0, STATE_BITMAP_SIZE);
+    size_t size = STATE_BITMAP_SIZE;
+    for (size_t chunk = 0; chunk < STATE_CHUNK_COUNT; chunk++) {
+        size_t offset = chunk * STATE_CHUNK_SIZE;
+        size_t length = sizeof(chip8_state_t) - offset < STATE_CHUNK_SIZE ? sizeof(chip8_state_t) - offset : STATE_CHUNK_SIZE;
+        if (memcmp(base + offset, bytes + offset, length) != 0) {
+            out[chunk / 8] |= 1 << (chunk % 8);
+            memcpy(out + size, bytes + offset, length);
+            size += length;
+        }
+    }
+    return size;
+}
+
+static void apply_delta(chip8_state_t* state, const uint8_t* delta) {
+    uint8_t* bytes = (uint8_t*)state;
+    const uint8_t* in = delta + STATE_BITMAP_SIZE;
+    for (size_t chunk = 0; chunk < STATE_CHUNK_COUNT; chunk++) {
+        if (delta[chunk / 8] & (1 << (chunk % 8))) {
+            size_t offset = chunk * STATE_CHUNK_SIZE;
+            size_t length = sizeof(chip8_state_t) - offset < STATE_CHUNK_SIZE ? sizeof(chip8_state_t) - offset : STATE_CHUNK_SIZE;
+            memcpy(bytes + offset, in, length);
+            in += length;
+        }
+    }
+}
+
+static bool store_frame(rewind_frame_t* frame, const void* data, size_t size, bool is_keyframe) {
+    if (frame->capacity < size) {
+        uint8_t* resized = realloc(frame->data, size);
+        if (!resized) {
+            return false;
+        }
+        frame->data = resized;
+        frame->capacity = size;
+    }
+    memcpy(frame->data, data, size);
+    frame->size = size;
+    frame->is_keyframe = is_keyframe;
+    return true;
+}
+
+rewind_buffer_t* rewind_create(int capacity, int keyframe_interval) {
+    if (capacity <= 0 || keyframe_interval <= 0) {
+        return NULL;
+    }
+
+    rewind_buffer_t* rewind = calloc(1, sizeof(rewind_buffer_t));
+    if (!rewind) {
+        return NULL;
+    }
+    rewind->frames = calloc(capacity, sizeof(rewind_frame_t));
+    if (!rewind->frames) {
+        free(rewind);
+        return NULL;
+    }
+    rewind->capacity = capacity;
+    rewind->newest = capacity - 1;
+    rewind->keyframe_interval = keyframe_interval;
+    return rewind;
+}
+
+void rewind_destroy(rewind_buffer_t* rewind) {
+    if (!rewind) {
+        return;
+    }
+    for (int i = 0; i < rewind->capacity; i++) {
+        free(rewind->frames[i].data);
+    }
+    free(rewind->frames);
+    free(rewind);
+}
+
+bool rewind_push(rewind_buffer_t* rewind, const chip8_t* cpu) {
+    chip8_state_t state;
+    save_chip8_state(cpu, &state);
+
+    // Drop the oldest frame when full, along with the deltas that depended on its keyframe
+    int slot = (rewind->newest + 1) % rewind->capacity;
+    if (rewind->count == rewind->capacity) {
+        rewind->count--;
+        while (rewind->count && !rewind->frames[(rewind->newest - rewind->count + 1 + rewind->capacity) % rewind->capacity].is_keyframe) {
+            rewind->count--;
+        }
+    }
+
+    // Take a keyframe on the interval, before the ring would overwrite the current one, or when the delta gets large
+    bool is_keyframe = !rewind->count || rewind->since_keyframe + 1 >= rewind->keyframe_interval ||
+                       rewind->since_keyframe + 2 > rewind->capacity;
+    size_t size = 0;
+    if (!is_keyframe) {
+        size = encode_delta(&rewind->keyframe, &state, rewind->delta);
+        is_keyframe = size > sizeof(chip8_state_t) / 2;
+    }
+
+    bool is_stored = is_keyframe ? store_frame(&rewind->frames[slot], &state, sizeof(state), true)
+                                 : store_frame(&rewind->frames[slot], rewind->delta, size, false);
+    if (!is_stored) {
+        return false;
+    }
+
+    if (is_keyframe) {
+        memcpy(&rewind->keyframe, &state, sizeof(state));
+        rewind->since_keyframe = 0;
+    } else {
+        rewind->since_keyframe++;
+    }
+    rewind->newest = slot;
+    rewind->count++;
+    return true;
+}
+
+int rewind_count(const rewind_buffer_t* rewind) {
+    return rewind->count;
+}
+
+bool rewind_restore(rewind_buffer_t* rewind, chip8_t* cpu, int frames) {
+    if (frames < 0 || frames >= rewind->count) {
+        return false;
+    }
+
+    int slot = (rewind->newest - frames + rewind->capacity) % rewind->capacity;
+    int distance = 0;
+    while (!rewind->frames[(slot - distance + rewind->capacity) % rewind->capacity].is_keyframe) {
+        distance++;
+    }
+
+    // The keyframe becomes the base for new deltas, frames after the restored one are dropped
+    memcpy(&rewind->keyframe, rewind->frames[(slot - distance + rewind->capacity) % rewind->capacity].data, sizeof(chip8_state_t));
+    rewind->since_keyframe = distance;
+    rewind->newest = slot;
+    rewind->count -= frames;
+
+    chip8_state_t state = rewind->keyframe;
+    if (distance) {
+        apply_delta(&state, rewind->frames[slot].data);
+    }
+    load_chip8_state(cpu, &state);
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "chip8_t.h"
+
+#define STATE_FILE_VERSION 7
+
+// Everything a program can observe, without the decode cache and JIT that are rebuilt on demand
+typedef struct {
+    uint8_t memory[MEMORY_SIZE];
+    uint16_t pc;
+    uint16_t stack[STACK_SIZE];
+    uint8_t sp;
+    uint8_t v[REGISTERS_COUNT];
+    uint16_t i;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t audio_pattern[AUDIO_PATTERN_SIZE];
+    uint8_t audio_pitch;
+    bool is_audio_pattern;
+    uint64_t display[DISPLAY_PLANES][DISPLAY_HEIGHT][DISPLAY_WORDS];
+    bool is_hires;
+    uint8_t planes;
+    bool is_redraw_needed;
+    bool keyboard[KEYBOARD_SIZE];
+    uint8_t wait_state;
+    uint8_t wait_key;
+    bool is_illegal;
+    uint16_t illegal_opcode;
+    uint64_t instruction_count;
+    uint64_t random_state;
+    uint8_t rpl_flags[RPL_FLAGS_COUNT];
+    uint8_t quirks;  // `quirks_t` the program runs under
+} chip8_state_t;
+
+typedef struct rewind_buffer rewind_buffer_t;
+
+void save_chip8_state(const chip8_t* cpu, chip8_state_t* state);
+void load_chip8_state(chip8_t* cpu, const chip8_state_t* state);
+bool save_chip8_state_file(const chip8_t* cpu, const char* filename);
+bool load_chip8_state_file(chip8_t* cpu, const char* filename);
+
+rewind_buffer_t* rewind_create(int capacity, int keyframe_interval);
+void rewind_destroy(rewind_buffer_t* rewind);
+bool rewind_push(rewind_buffer_t* rewind, const chip8_t* cpu);
+int rewind_count(const rewind_buffer_t* rewind);
+bool rewind_restore(rewind_buffer_t* rewind, chip8_t* cpu, int frames);
@@ -0,0 +1,388 @@
+#include "threaded.h"
+
+#include "chip8.h"
+#include "instructions.h"
+
+// Use computed goto where the compiler supports it, a switch otherwise
+#if defined(__GNUC__)
+#define TARGET(op) TARGET_##op:
+#define DISPATCH() goto* LABELS[instruction->op]
+#else
+#define TARGET(op) case op:
+#define DISPATCH() goto dispatch  // Back to the switch, `continue` would only leave the do-while of `NEXT`
+#endif
+
+// Advance to the next instruction of the block, or leave if the block was cut at `BLOCK_MAX_LENGTH`
+#define NEXT()                   \
+    do {                         \
+        pc += 2;                 \
+        instruction += 2;        \
+        if (--remaining == 0) {  \
+            cpu->pc = pc;        \
+            goto block_done;     \
+        }                        \
+        DISPATCH();              \
+    } while (0)
+
+// Run a handler from `instructions.c`, which expects the program counter past the instruction
+#define CALL()                                   \
+    do {                                         \
+        cpu->pc = pc + 2;                        \
+        instruction->handler(cpu, instruction);  \
+    } while (0)
+
+// Ops that end a basic block: control flow, the retrying ops, memory writes that may overwrite the block itself
+// and the double-wide F000 NNNN
+static const bool IS_BLOCK_END[OP_COUNT] = {
+    [OP_00EE] = true,
+    [OP_1NNN] = true,
+    [OP_2NNN] = true,
+    [OP_3XNN] = true,
+    [OP_4XNN] = true,
+    [OP_5XY0] = true,
+    [OP_9XY0] = true,
+    [OP_BNNN] = true,
+    [OP_DXYN] = true,
+    [OP_EX9E] = true,
+    [OP_EXA1] = true,
+    [OP_FX0A] = true,
+    [OP_FX33] = true,
+    [OP_FX55] = true,
+    [OP_F000] = true,
+    [OP_5XY2] = true,
+};
+
+static instruction_t* build_block(chip8_t* cpu, uint16_t start) {
+    uint16_t address = start;
+    int length = 0;
+    while (length < BLOCK_MAX_LENGTH) {
+        instruction_t* instruction = fetch_instruction(cpu, address);
+        length++;
+
+        // Stop at the last slot of the cache, blocks are walked slot by slot and can't wrap around,
+        // which also stops them at the end of memory
+        if (IS_BLOCK_END[instruction->op] || (address & (DECODE_CACHE_SIZE - 1)) + 2 > DECODE_CACHE_SIZE - 2) {
+            break;
+        }
+        address += 2;
+    }
+
+    instruction_t* first = &cpu->cache[start & (DECODE_CACHE_SIZE - 1)];
+    first->block_length = length;
+    return first;
+}
+
+// Returns the instructions run, less than `budget` if one started waiting
+int run_threaded(chip8_t* cpu, int budget) {
+#if defined(__GNUC__)
+    static const void* const LABELS[OP_COUNT] = {
+        [OP_ILLEGAL] = &&TARGET_OP_ILLEGAL,
+        [OP_00E0] = &&TARGET_OP_00E0,
+        [OP_00EE] = &&TARGET_OP_00EE,
+        [OP_1NNN] = &&TARGET_OP_1NNN,
+        [OP_2NNN] = &&TARGET_OP_2NNN,
+        [OP_3XNN] = &&TARGET_OP_3XNN,
+        [OP_4XNN] = &&TARGET_OP_4XNN,
+        [OP_5XY0] = &&TARGET_OP_5XY0,
+        [OP_6XNN] = &&TARGET_OP_6XNN,
+        [OP_7XNN] = &&TARGET_OP_7XNN,
+        [OP_8XY0] = &&TARGET_OP_8XY0,
+        [OP_8XY1] = &&TARGET_OP_8XY1,
+        [OP_8XY2] = &&TARGET_OP_8XY2,
+        [OP_8XY3] = &&TARGET_OP_8XY3,
+        [OP_8XY4] = &&TARGET_OP_8XY4,
+        [OP_8XY5] = &&TARGET_OP_8XY5,
+        [OP_8XY6] = &&TARGET_OP_8XY6,
+        [OP_8XY7] = &&TARGET_OP_8XY7,
+        [OP_8XYE] = &&TARGET_OP_8XYE,
+        [OP_9XY0] = &&TARGET_OP_9XY0,
+        [OP_ANNN] = &&TARGET_OP_ANNN,
+        [OP_BNNN] = &&TARGET_OP_BNNN,
+        [OP_CXNN] = &&TARGET_OP_CXNN,
+        [OP_DXYN] = &&TARGET_OP_DXYN,
+        [OP_EX9E] = &&TARGET_OP_EX9E,
+        [OP_EXA1] = &&TARGET_OP_EXA1,
+        [OP_FX07] = &&TARGET_OP_FX07,
+        [OP_FX0A] = &&TARGET_OP_FX0A,
+        [OP_FX15] = &&TARGET_OP_FX15,
+        [OP_FX18] = &&TARGET_OP_FX18,
+        [OP_FX1E] = &&TARGET_OP_FX1E,
+        [OP_FX29] = &&TARGET_OP_FX29,
+        [OP_FX33] = &&TARGET_OP_FX33,
+        [OP_FX55] = &&TARGET_OP_FX55,
+        [OP_FX65] = &&TARGET_OP_FX65,
+        [OP_F002] = &&TARGET_OP_F002,
+        [OP_FX3A] = &&TARGET_OP_FX3A,
+        [OP_00CN] = &&TARGET_OP_00CN,
+        [OP_00FB] = &&TARGET_OP_00FB,
+        [OP_00FC] = &&TARGET_OP_00FC,
+        [OP_00FE] = &&TARGET_OP_00FE,
+        [OP_00FF] = &&TARGET_OP_00FF,
+        [OP_FX30] = &&TARGET_OP_FX30,
+        [OP_FX75] = &&TARGET_OP_FX75,
+        [OP_FX85] = &&TARGET_OP_FX85,
+        [OP_00DN] = &&TARGET_OP_00DN,
+        [OP_F000] = &&TARGET_OP_F000,
+        [OP_5XY2] = &&TARGET_OP_5XY2,
+        [OP_5XY3] = &&TARGET_OP_5XY3,
+        [OP_FN01] = &&TARGET_OP_FN01,
+    };
+#endif
+
+    uint8_t* v = cpu->v;
+    int executed = 0;
+
+    while (executed < budget) {
+        // Addresses past the end of memory can't start a block, let the interpreter wrap them
+        if (cpu->pc > MEMORY_SIZE - 2) {
+            step_chip8(cpu);
+            executed++;
+            if (cpu->wait_state) break;
+            continue;
+        }
+
+        // The slot may hold a block of another address mapped to it
+        instruction_t* instruction = &cpu->cache[cpu->pc & (DECODE_CACHE_SIZE - 1)];
+        if (!instruction->block_length || instruction->address != cpu->pc) {
+            instruction = build_block(cpu, cpu->pc);
+        }
+
+        // Finish the frame one instruction at a time if the whole block doesn't fit the budget
+        int remaining = instruction->block_length;
+        if (remaining > budget - executed) {
+            while (executed < budget && !cpu->wait_state) {
+                step_chip8(cpu);
+                executed++;
+            }
+            break;
+        }
+        executed += remaining;
+
+        uint16_t pc = cpu->pc;  // Address of the current instruction
+        for (;;) {
+#if defined(__GNUC__)
+            DISPATCH();
+#else
+        dispatch:
+            switch (instruction->op) {
+#endif
+            TARGET(OP_ILLEGAL) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_00E0) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_00EE) {
+                cpu->sp--;
+                cpu->pc = cpu->stack[cpu->sp % STACK_SIZE];
+                goto block_done;
+            }
+            TARGET(OP_1NNN) {
+                cpu->pc = instruction->nnn;
+                goto block_done;
+            }
+            TARGET(OP_2NNN) {
+                cpu->stack[cpu->sp % STACK_SIZE] = pc + 2;
+                cpu->sp++;
+                cpu->pc = instruction->nnn;
+                goto block_done;
+            }
+            TARGET(OP_3XNN) {
+                cpu->pc = pc + (v[instruction->x] == instruction->nn ? 2 + instruction->skip : 2);
+                goto block_done;
+            }
+            TARGET(OP_4XNN) {
+                cpu->pc = pc + (v[instruction->x] != instruction->nn ? 2 + instruction->skip : 2);
+                goto block_done;
+            }
+            TARGET(OP_5XY0) {
+                cpu->pc = pc + (v[instruction->x] == v[instruction->y] ? 2 + instruction->skip : 2);
+                goto block_done;
+            }
+            TARGET(OP_6XNN) {
+                v[instruction->x] = instruction->nn;
+                NEXT();
+            }
+            TARGET(OP_7XNN) {
+                v[instruction->x] += instruction->nn;
+                NEXT();
+            }
+            TARGET(OP_8XY0) {
+                v[instruction->x] = v[instruction->y];
+                NEXT();
+            }
+            TARGET(OP_8XY1) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_8XY2) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_8XY3) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_8XY4) {
+                uint16_t sum = v[instruction->x] + v[instruction->y];
+                v[instruction->x] = sum & 0xFF;
+                v[0xF] = sum > 0xFF;
+                NEXT();
+            }
+            TARGET(OP_8XY5) {
+                int8_t sub = v[instruction->x] - v[instruction->y];
+                v[instruction->x] = sub;
+                v[0xF] = sub >= 0;
+                NEXT();
+            }
+            TARGET(OP_8XY6) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_8XY7) {
+                int8_t sub = v[instruction->y] - v[instruction->x];
+                v[instruction->x] = sub;
+                v[0xF] = sub >= 0;
+                NEXT();
+            }
+            TARGET(OP_8XYE) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_9XY0) {
+                cpu->pc = pc + (v[instruction->x] != v[instruction->y] ? 2 + instruction->skip : 2);
+                goto block_done;
+            }
+            TARGET(OP_ANNN) {
+                cpu->i = instruction->nnn;
+                NEXT();
+            }
+            TARGET(OP_BNNN) {
+                CALL();
+                goto block_done;
+            }
+            TARGET(OP_CXNN) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_DXYN) {
+                CALL();
+                goto block_done;
+            }
+            TARGET(OP_EX9E) {
+                cpu->pc = pc + (cpu->keyboard[v[instruction->x] & (KEYBOARD_SIZE - 1)] ? 2 + instruction->skip : 2);
+                goto block_done;
+            }
+            TARGET(OP_EXA1) {
+                cpu->pc = pc + (!cpu->keyboard[v[instruction->x] & (KEYBOARD_SIZE - 1)] ? 2 + instruction->skip : 2);
+                goto block_done;
+            }
+            TARGET(OP_FX07) {
+                v[instruction->x] = cpu->delay_timer;
+                NEXT();
+            }
+            TARGET(OP_FX0A) {
+                CALL();
+                goto block_done;
+            }
+            TARGET(OP_FX15) {
+                cpu->delay_timer = v[instruction->x];
+                NEXT();
+            }
+            TARGET(OP_FX18) {
+                cpu->sound_timer = v[instruction->x];
+                NEXT();
+            }
+            TARGET(OP_FX1E) {
+                cpu->i += v[instruction->x];
+                NEXT();
+            }
+            TARGET(OP_FX29) {
+                cpu->i = FONTSET_START_ADDR + (v[instruction->x] * 5);
+                NEXT();
+            }
+            TARGET(OP_FX33) {
+                CALL();
+                goto block_done;
+            }
+            TARGET(OP_FX55) {
+                CALL();
+                goto block_done;
+            }
+            TARGET(OP_FX65) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_F002) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_FX3A) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_00CN) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_00FB) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_00FC) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_00FE) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_00FF) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_FX30) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_FX75) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_FX85) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_00DN) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_F000) {
+                CALL();
+                goto block_done;
+            }
+            TARGET(OP_5XY2) {
+                CALL();
+                goto block_done;
+            }
+            TARGET(OP_5XY3) {
+                CALL();
+                NEXT();
+            }
+            TARGET(OP_FN01) {
+                CALL();
+                NEXT();
+            }
+#if !defined(__GNUC__)
+            }
+#endif
+        }
+    block_done:
+        // DXYN or FX0A started waiting, sleep through the rest of the budget
+        if (cpu->wait_state) break;
+    }
+
+    return executed;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "chip8_t.h"
+
+int run_threaded(chip8_t* cpu, int budget);
@@ -0,0 +1,34 @@
+#include "triple_buffer.h"
+
+#include <string.h>
+
+#define TRIPLE_BUFFER_INDEX 0x3
+#define TRIPLE_BUFFER_FRESH 0x4
+
+void triple_buffer_init(triple_buffer_t* buffer) {
+    memset(buffer->frames, 0, sizeof(buffer->frames));
+    buffer->back = 0;
+    atomic_init(&buffer->middle, 1);
+    buffer->front = 2;
+}
+
+// Slot the producer fills before publishing it
+frame_t* triple_buffer_back(triple_buffer_t* buffer) {
+    return &buffer->frames[buffer->back];
+}
+
+void triple_buffer_publish(triple_buffer_t* buffer) {
+    // Release the written frame, acquire the slot the consumer may have just handed back
+    unsigned middle = atomic_exchange_explicit(&buffer->middle, buffer->back | TRIPLE_BUFFER_FRESH, memory_order_acq_rel);
+    buffer->back = middle & TRIPLE_BUFFER_INDEX;
+}
+
+// Latest published frame, or the one returned last time if nothing new was published
+const frame_t* triple_buffer_front(triple_buffer_t* buffer, bool* is_new) {
+    *is_new = atomic_load_explicit(&buffer->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH;
+    if (*is_new) {
+        unsigned middle = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel);
+        buffer->front = middle & TRIPLE_BUFFER_INDEX;
+    }
+    return &buffer->frames[buffer->front];
+}
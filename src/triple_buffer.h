@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdatomic.h>
+
+#include "chip8_t.h"
+
+// What the render thread needs from one emulated frame
+typedef struct {
+    uint64_t display[DISPLAY_PLANES][DISPLAY_HEIGHT][DISPLAY_WORDS];
+    bool is_hires;
+    uint64_t dirty_rows;    // Rows changed since the previous published frame, see `chip8_t.dirty_rows`
+    uint64_t frame_number;  // Counts published frames, a gap means frames were dropped along with their dirty rows
+} frame_t;
+
+// Lock-free handoff of the latest frame from one producer to one consumer, neither side ever waits:
+// the producer fills the back slot and swaps it with the middle one, the consumer swaps the middle one
+// with its front slot when it holds a frame it hasn't seen
+typedef struct {
+    frame_t frames[3];
+    atomic_uint middle;  // Index of the middle slot, `TRIPLE_BUFFER_FRESH` set while it holds an unread frame
+    unsigned back;       // Owned by the producer
+    unsigned front;      // Owned by the consumer
+} triple_buffer_t;
+
+void triple_buffer_init(triple_buffer_t* buffer);
+frame_t* triple_buffer_back(triple_buffer_t* buffer);
+void triple_buffer_publish(triple_buffer_t* buffer);
+const frame_t* triple_buffer_front(triple_buffer_t* buffer, bool* is_new);
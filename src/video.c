@@ -5,10 +5,46 @@
 #define SCREEN_SCALE_FACTOR 10
 #define PIXEL_ON_COLOR 0xFFFFFFFF
 #define PIXEL_OFF_COLOR 0x00000000
+#define PIXEL_PLANE_2_COLOR 0x808080FF  // XO-CHIP pixels set in the second plane only
+#define PIXEL_BOTH_COLOR 0xC0C0C0FF     // XO-CHIP pixels set in both planes
 
 static SDL_Window* window = NULL;
 static SDL_Renderer* renderer = NULL;
 static SDL_Texture* texture = NULL;
+static uint64_t shown_frame_number = 0;  // Frame the texture holds, 0 before the first upload
+static bool is_texture_hires = false;    // Mode the texture is sized for
+static bool is_present_needed = false;   // The window lost its contents, present even without changes
+
+// Creates the texture at the size of the display mode, replacing the previous one
+static bool create_texture(bool is_hires) {
+    int width = is_hires ? DISPLAY_WIDTH : LORES_WIDTH;
+    int height = is_hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+
+    if (texture) {
+        SDL_DestroyTexture(texture);
+    }
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (!texture) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to create texture: %s", SDL_GetError());
+        return false;
+    }
+    is_texture_hires = is_hires;
+    shown_frame_number = 0;  // The new texture holds nothing yet
+
+    // Set fixed aspect ratio
+    if (!SDL_SetRenderLogicalPresentation(renderer, width, height, SDL_LOGICAL_PRESENTATION_LETTERBOX)) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to set logical presentation: %s", SDL_GetError());
+        return false;
+    }
+
+    // Use nearest neighbor scaling
+    if (!SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST)) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to set texture scale mode: %s", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
 
 bool video_init(void) {
     if (!SDL_Init(SDL_INIT_VIDEO)) {
@@ -16,7 +52,7 @@ bool video_init(void) {
         return false;
     }
 
-    window = SDL_CreateWindow("CHIP-8", DISPLAY_WIDTH * SCREEN_SCALE_FACTOR, DISPLAY_HEIGHT * SCREEN_SCALE_FACTOR, SDL_WINDOW_RESIZABLE);
+    window = SDL_CreateWindow("CHIP-8", LORES_WIDTH * SCREEN_SCALE_FACTOR, LORES_HEIGHT * SCREEN_SCALE_FACTOR, SDL_WINDOW_RESIZABLE);
     if (!window) {
         SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to create window: %s", SDL_GetError());
         video_cleanup();
@@ -30,45 +66,70 @@ bool video_init(void) {
         return false;
     }
 
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, DISPLAY_WIDTH, DISPLAY_HEIGHT);
-    if (!texture) {
-        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to create texture: %s", SDL_GetError());
+    if (!create_texture(false)) {
         video_cleanup();
         return false;
     }
 
-    // Set fixed aspect ratio
-    if (!SDL_SetRenderLogicalPresentation(renderer, DISPLAY_WIDTH, DISPLAY_HEIGHT, SDL_LOGICAL_PRESENTATION_LETTERBOX)) {
-        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to set logical presentation: %s", SDL_GetError());
-        video_cleanup();
-        return false;
-    }
+    return true;
+}
 
-    // Use nearest neighbor scaling
-    if (!SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST)) {
-        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to set texture scale mode: %s", SDL_GetError());
-        video_cleanup();
-        return false;
+// Convert one display row of `words` words per plane to colors, the color is picked from the bit of each plane
+// with masks, branchless so the compiler can vectorize the loop
+static void convert_row(const uint64_t* plane_1, const uint64_t* plane_2, int words, uint32_t* pixels) {
+    for (int word = 0; word < words; word++) {
+        for (int x = 0; x < 64; x++) {
+            uint32_t mask_1 = -(uint32_t)((plane_1[word] >> (63 - x)) & 1);
+            uint32_t mask_2 = -(uint32_t)((plane_2[word] >> (63 - x)) & 1);
+            pixels[word * 64 + x] = (~mask_1 & ~mask_2 & PIXEL_OFF_COLOR) | (mask_1 & ~mask_2 & PIXEL_ON_COLOR) |
+                                    (~mask_1 & mask_2 & PIXEL_PLANE_2_COLOR) | (mask_1 & mask_2 & PIXEL_BOTH_COLOR);
+        }
     }
-
-    return true;
 }
 
-bool video_update(chip8_t* cpu) {
-    if (!cpu->is_redraw_needed) {
-        return true;
+bool video_update(const frame_t* frame) {
+    // A mode change needs a texture of the new size, which is then uploaded in full
+    if (frame->is_hires != is_texture_hires && !create_texture(frame->is_hires)) {
+        return false;
     }
+    int width = frame->is_hires ? DISPLAY_WIDTH : LORES_WIDTH;
+    int height = frame->is_hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
 
-    // Convert monochrome display to color buffer
-    uint32_t buffer[DISPLAY_WIDTH * DISPLAY_HEIGHT];
-    for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; i++) {
-        buffer[i] = cpu->display[i] ? PIXEL_ON_COLOR : PIXEL_OFF_COLOR;
+    // Only the rows changed since the frame the texture holds, none if it holds this frame already,
+    // all of them if frames were dropped in between
+    uint64_t dirty_rows = frame->dirty_rows;
+    if (shown_frame_number && frame->frame_number == shown_frame_number) {
+        dirty_rows = 0;
+    } else if (!shown_frame_number || frame->frame_number != shown_frame_number + 1) {
+        dirty_rows = DISPLAY_ALL_ROWS;
+    }
+    dirty_rows &= DISPLAY_ALL_ROWS >> (DISPLAY_HEIGHT - height);
+    shown_frame_number = frame->frame_number;
+    if (!dirty_rows && !is_present_needed) {
+        return true;  // Nothing changed and the window still shows it, skip the present
     }
+    is_present_needed = false;
 
-    if (!SDL_UpdateTexture(texture, NULL, buffer, DISPLAY_WIDTH * sizeof(uint32_t))) {
-        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to update texture: %s", SDL_GetError());
-        return false;
+    // Write each run of dirty rows straight into the texture, locked pixels don't keep the old contents
+    while (dirty_rows) {
+        int first = __builtin_ctzll(dirty_rows);
+        uint64_t run = dirty_rows >> first;
+        int count = ~run ? __builtin_ctzll(~run) : 64;
+        dirty_rows = count < 64 ? dirty_rows & ~(((1ull << count) - 1) << first) : 0;
+
+        SDL_Rect rect = {0, first, width, count};
+        void* pixels;
+        int pitch;
+        if (!SDL_LockTexture(texture, &rect, &pixels, &pitch)) {
+            SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to lock texture: %s", SDL_GetError());
+            return false;
+        }
+        for (int y = 0; y < count; y++) {
+            convert_row(frame->display[0][first + y], frame->display[1][first + y], width / 64, (uint32_t*)((uint8_t*)pixels + y * pitch));
+        }
+        SDL_UnlockTexture(texture);
     }
+
     if (!SDL_RenderClear(renderer)) {
         SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to clear renderer: %s", SDL_GetError());
         return false;
@@ -82,11 +143,18 @@ bool video_update(chip8_t* cpu) {
         return false;
     }
 
-    cpu->is_redraw_needed = false;
     return true;
 }
 
+// The window was exposed or resized, its contents are undefined until the next present
+void video_expose(void) {
+    is_present_needed = true;
+}
+
 void video_cleanup(void) {
+    shown_frame_number = 0;
+    is_present_needed = false;
+    is_texture_hires = false;
     if (texture) {
         SDL_DestroyTexture(texture);
         texture = NULL;
@@ -1,7 +1,8 @@
 #pragma once
 
-#include "chip8_t.h"
+#include "triple_buffer.h"
 
 bool video_init(void);
-bool video_update(chip8_t* cpu);
+bool video_update(const frame_t* frame);
+void video_expose(void);
 void video_cleanup(void);
@@ -0,0 +1,522 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "instructions.h"
+#include "quirks.h"
+
+#define DEFAULT_NAME "aot_rom"
+#define ROM_BYTES_PER_LINE 12
+
+typedef struct {
+    const char* rom;
+    const char* output;
+    const char* name;  // Symbol of the generated `aot_t`
+    quirks_t quirks;
+} options_t;
+
+// Ops that end a block: control flow, the waiting ops, whose handlers return to the caller, and memory writes,
+// so the code after them is compared with the ROM before it runs, in case they wrote over it
+static const bool IS_BLOCK_END[OP_COUNT] = {
+    [OP_00EE] = true,
+    [OP_1NNN] = true,
+    [OP_2NNN] = true,
+    [OP_3XNN] = true,
+    [OP_4XNN] = true,
+    [OP_5XY0] = true,
+    [OP_9XY0] = true,
+    [OP_BNNN] = true,
+    [OP_DXYN] = true,
+    [OP_EX9E] = true,
+    [OP_EXA1] = true,
+    [OP_FX0A] = true,
+    [OP_FX33] = true,
+    [OP_FX55] = true,
+    [OP_5XY2] = true,
+};
+
+// Ops compiled to C in place, they only touch registers and timers, the others call their handlers, EX9E and EXA1
+// included, so keys past the keypad read the same as in the interpreter
+static const bool IS_INLINED[OP_COUNT] = {
+    [OP_00EE] = true,
+    [OP_1NNN] = true,
+    [OP_2NNN] = true,
+    [OP_3XNN] = true,
+    [OP_4XNN] = true,
+    [OP_5XY0] = true,
+    [OP_6XNN] = true,
+    [OP_7XNN] = true,
+    [OP_8XY0] = true,
+    [OP_8XY1] = true,
+    [OP_8XY2] = true,
+    [OP_8XY3] = true,
+    [OP_8XY4] = true,
+    [OP_8XY5] = true,
+    [OP_8XY6] = true,
+    [OP_8XY7] = true,
+    [OP_8XYE] = true,
+    [OP_9XY0] = true,
+    [OP_ANNN] = true,
+    [OP_BNNN] = true,
+    [OP_CXNN] = true,
+    [OP_FX07] = true,
+    [OP_FX15] = true,
+    [OP_FX18] = true,
+    [OP_FX1E] = true,
+    [OP_FX29] = true,
+    [OP_FX30] = true,
+    [OP_FX3A] = true,
+    [OP_F000] = true,
+    [OP_FN01] = true,
+};
+
+#define QUIRK_ID_ENTRY(id, ...) [QUIRKS_##id] = "QUIRKS_" #id,
+
+static const char* const QUIRK_IDS[QUIRKS_COUNT] = {FOR_EACH_QUIRK_PROFILE(QUIRK_ID_ENTRY)};
+
+static chip8_t cpu;                       // ROM image, decoded by the core's own `fetch_instruction`
+static uint32_t rom_end;                  // First address past the compiled code
+static bool is_block_start[MEMORY_SIZE];  // Addresses reached by static control flow, one block each
+static uint16_t worklist[MEMORY_SIZE];    // Block starts not decoded yet
+static int worklist_count;
+
+static void print_usage(const char* name) {
+    printf("Usage: %s <ROM> <OUTPUT> [--quirks=NAME] [--name NAME]\n", name);
+    printf("  --quirks=NAME  Quirk profile the ROM runs with, vip, chip48, schip or xochip (default vip)\n");
+    printf("  --name NAME    Symbol of the generated engine (default %s)\n", DEFAULT_NAME);
+}
+
+static bool parse_options(int argc, char* argv[], options_t* options) {
+    *options = (options_t){
+        .name = DEFAULT_NAME,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strncmp(argv[i], "--quirks=", 9) == 0) {
+            if (!parse_quirks(argv[i] + 9, &options->quirks)) return false;
+        } else if (strcmp(argv[i], "--name") == 0 && has_value) {
+            options->name = argv[++i];
+        } else if (argv[i][0] != '-' && !options->rom) {
+            options->rom = argv[i];
+        } else if (argv[i][0] != '-' && !options->output) {
+            options->output = argv[i];
+        } else {
+            return false;
+        }
+    }
+    return options->rom && options->output;
+}
+
+static int get_instruction_size(const instruction_t* instruction) {
+    return instruction->op == OP_F000 ? 4 : 2;
+}
+
+static bool is_skip(uint8_t op) {
+    return op == OP_3XNN || op == OP_4XNN || op == OP_5XY0 || op == OP_9XY0 || op == OP_EX9E || op == OP_EXA1;
+}
+
+// Instructions from `start` up to the first block end, stopping at `BLOCK_MAX_LENGTH` and the end of the ROM
+static int decode_block(uint16_t start, instruction_t* block) {
+    uint32_t address = start;
+    int length = 0;
+    while (length < BLOCK_MAX_LENGTH && address + 2 <= rom_end) {
+        instruction_t instruction = *fetch_instruction(&cpu, address);
+        if (address + get_instruction_size(&instruction) > rom_end) {
+            break;
+        }
+        block[length++] = instruction;
+        if (IS_BLOCK_END[instruction.op]) {
+            break;
+        }
+        address += get_instruction_size(&instruction);
+    }
+    return length;
+}
+
+static void add_block(uint32_t address) {
+    if (address >= PC_START_ADDR && address + 2 <= rom_end && !is_block_start[address]) {
+        is_block_start[address] = true;
+        worklist[worklist_count++] = address;
+    }
+}
+
+// Follows jumps, calls, returns sites and both sides of skips, BNNN and 00EE go through the dispatcher at runtime
+static void find_blocks(void) {
+    add_block(PC_START_ADDR);
+    while (worklist_count > 0) {
+        uint16_t start = worklist[--worklist_count];
+        instruction_t block[BLOCK_MAX_LENGTH];
+        int length = decode_block(start, block);
+        if (length == 0) {
+            is_block_start[start] = false;
+            continue;
+        }
+
+        const instruction_t* last = &block[length - 1];
+        uint32_t next = last->address + get_instruction_size(last);
+        switch (last->op) {
+            case OP_1NNN:
+                add_block(last->nnn);
+                break;
+            case OP_2NNN:
+                add_block(last->nnn);
+                add_block(next);
+                break;
+            case OP_00EE:
+            case OP_BNNN:
+                break;
+            default:
+                add_block(next);
+                if (is_skip(last->op)) {
+                    add_block(next + last->skip);
+                }
+                break;
+        }
+    }
+}
+
+// Sets the program counter and continues in the block there, or in the dispatcher if it wasn't compiled
+static void emit_jump(FILE* out, const char* indent, uint32_t address) {
+    address &= MEMORY_SIZE - 1;
+    fprintf(out, "%scpu->pc = 0x%04X;\n", indent, address);
+    if (is_block_start[address]) {
+        fprintf(out, "%sgoto block_%04X;\n", indent, address);
+    } else {
+        fprintf(out, "%sgoto dispatch;\n", indent);
+    }
+}
+
+// C for the ops that only touch registers and timers
+static void emit_inline(FILE* out, const instruction_t* instruction, const quirk_profile_t* quirks) {
+    int x = instruction->x;
+    int y = instruction->y;
+    switch (instruction->op) {
+        case OP_6XNN:
+            fprintf(out, "    cpu->v[0x%X] = 0x%02X;\n", x, instruction->nn);
+            break;
+        case OP_7XNN:
+            fprintf(out, "    cpu->v[0x%X] += 0x%02X;\n", x, instruction->nn);
+            break;
+        case OP_8XY0:
+            fprintf(out, "    cpu->v[0x%X] = cpu->v[0x%X];\n", x, y);
+            break;
+        case OP_8XY1:
+        case OP_8XY2:
+        case OP_8XY3:
+            fprintf(out, "    cpu->v[0x%X] %c= cpu->v[0x%X];\n", x, "|&^"[instruction->op - OP_8XY1], y);
+            if (quirks->is_vf_reset) {
+                fprintf(out, "    cpu->v[0xF] = 0;\n");
+            }
+            break;
+        case OP_8XY4:
+            fprintf(out, "    {\n");
+            fprintf(out, "        uint16_t sum = cpu->v[0x%X] + cpu->v[0x%X];\n", x, y);
+            fprintf(out, "        cpu->v[0x%X] = sum & 0xFF;\n", x);
+            fprintf(out, "        cpu->v[0xF] = sum > 0xFF;\n");
+            fprintf(out, "    }\n");
+            break;
+        case OP_8XY5:
+        case OP_8XY7:
+            fprintf(out, "    {\n");
+            if (instruction->op == OP_8XY5) {
+                fprintf(out, "        int8_t sub = cpu->v[0x%X] - cpu->v[0x%X];\n", x, y);
+            } else {
+                fprintf(out, "        int8_t sub = cpu->v[0x%X] - cpu->v[0x%X];\n", y, x);
+            }
+            fprintf(out, "        cpu->v[0x%X] = sub;\n", x);
+            fprintf(out, "        cpu->v[0xF] = sub >= 0;\n");
+            fprintf(out, "    }\n");
+            break;
+        case OP_8XY6:
+        case OP_8XYE:
+            fprintf(out, "    {\n");
+            fprintf(out, "        uint8_t value = cpu->v[0x%X];\n", quirks->is_shift_vy ? y : x);
+            if (instruction->op == OP_8XY6) {
+                fprintf(out, "        cpu->v[0x%X] = value >> 1;\n", x);
+                fprintf(out, "        cpu->v[0xF] = value & 0x1;\n");
+            } else {
+                fprintf(out, "        cpu->v[0x%X] = value << 1;\n", x);
+                fprintf(out, "        cpu->v[0xF] = (value & 0x80) ? 1 : 0;\n");
+            }
+            fprintf(out, "    }\n");
+            break;
+        case OP_ANNN:
+            fprintf(out, "    cpu->i = 0x%03X;\n", instruction->nnn);
+            break;
+        case OP_CXNN:
+            fprintf(out, "    cpu->v[0x%X] = next_chip8_random(cpu) & 0x%02X;\n", x, instruction->nn);
+            break;
+        case OP_FX07:
+            fprintf(out, "    cpu->v[0x%X] = cpu->delay_timer;\n", x);
+            break;
+        case OP_FX15:
+            fprintf(out, "    cpu->delay_timer = cpu->v[0x%X];\n", x);
+            break;
+        case OP_FX18:
+            fprintf(out, "    cpu->sound_timer = cpu->v[0x%X];\n", x);
+            break;
+        case OP_FX1E:
+            fprintf(out, "    cpu->i += cpu->v[0x%X];\n", x);
+            break;
+        case OP_FX29:
+            fprintf(out, "    cpu->i = FONTSET_START_ADDR + (cpu->v[0x%X] * 5);\n", x);
+            break;
+        case OP_FX30:
+            fprintf(out, "    cpu->i = BIG_FONTSET_START_ADDR + (cpu->v[0x%X] & 0xF) * 10;\n", x);
+            break;
+        case OP_FX3A:
+            fprintf(out, "    cpu->audio_pitch = cpu->v[0x%X];\n", x);
+            break;
+        case OP_F000:
+            fprintf(out, "    cpu->i = 0x%04X;\n", instruction->nnn);
+            break;
+        case OP_FN01:
+            fprintf(out, "    cpu->planes = %d;\n", x & ((1 << DISPLAY_PLANES) - 1));
+            break;
+    }
+}
+
+// Condition under which a skip is taken, the key skips already ran their handlers
+static void emit_skip_condition(FILE* out, const instruction_t* instruction) {
+    int x = instruction->x;
+    int y = instruction->y;
+    uint32_t next = instruction->address + get_instruction_size(instruction);
+    switch (instruction->op) {
+        case OP_3XNN:
+            fprintf(out, "cpu->v[0x%X] == 0x%02X", x, instruction->nn);
+            break;
+        case OP_4XNN:
+            fprintf(out, "cpu->v[0x%X] != 0x%02X", x, instruction->nn);
+            break;
+        case OP_5XY0:
+            fprintf(out, "cpu->v[0x%X] == cpu->v[0x%X]", x, y);
+            break;
+        case OP_9XY0:
+            fprintf(out, "cpu->v[0x%X] != cpu->v[0x%X]", x, y);
+            break;
+        case OP_EX9E:
+        case OP_EXA1:
+            fprintf(out, "cpu->pc != 0x%04X", next);
+            break;
+    }
+}
+
+// Ends the block with its control flow, or falls through to the next one
+static void emit_block_end(FILE* out, const instruction_t* instruction, const quirk_profile_t* quirks) {
+    uint32_t next = instruction->address + get_instruction_size(instruction);
+    switch (instruction->op) {
+        case OP_00EE:
+            fprintf(out, "    cpu->sp--;\n");
+            fprintf(out, "    cpu->pc = cpu->stack[cpu->sp %% STACK_SIZE];\n");
+            fprintf(out, "    goto dispatch;\n");
+            break;
+        case OP_1NNN:
+            emit_jump(out, "    ", instruction->nnn);
+            break;
+        case OP_2NNN:
+            fprintf(out, "    cpu->stack[cpu->sp %% STACK_SIZE] = 0x%04X;\n", next);
+            fprintf(out, "    cpu->sp++;\n");
+            emit_jump(out, "    ", instruction->nnn);
+            break;
+        case OP_BNNN:
+            fprintf(out, "    cpu->pc = cpu->v[0x%X] + 0x%03X;\n", quirks->is_jump_vx ? instruction->x : 0, instruction->nnn);
+            fprintf(out, "    goto dispatch;\n");
+            break;
+        default:
+            if (is_skip(instruction->op)) {
+                fprintf(out, "    if (");
+                emit_skip_condition(out, instruction);
+                fprintf(out, ") {\n");
+                emit_jump(out, "        ", next + instruction->skip);
+                fprintf(out, "    }\n");
+            }
+            emit_jump(out, "    ", next);
+            break;
+    }
+}
+
+// Operands of the instructions run by their handlers, in the order the blocks call them, returns how many
+static int emit_instructions(FILE* out) {
+    int count = 0;
+    for (uint32_t address = PC_START_ADDR; address < rom_end; address++) {
+        instruction_t block[BLOCK_MAX_LENGTH];
+        int length = is_block_start[address] ? decode_block(address, block) : 0;
+        for (int i = 0; i < length; i++) {
+            const instruction_t* instruction = &block[i];
+            if (IS_INLINED[instruction->op]) {
+                continue;
+            }
+            if (count++ == 0) {
+                fprintf(out, "static const instruction_t INSTRUCTIONS[] = {\n");
+            }
+            fprintf(out, "    {.address = 0x%04X, .opcode = 0x%04X, .nnn = 0x%04X, .x = 0x%X, .y = 0x%X, .n = 0x%X, .nn = 0x%02X, .op = OP_%s, .skip = %d},\n",
+                    instruction->address, instruction->opcode, instruction->nnn, instruction->x, instruction->y,
+                    instruction->n, instruction->nn, OP_NAMES[instruction->op], instruction->skip);
+        }
+    }
+    if (count > 0) {
+        fprintf(out, "};\n\n");
+    }
+    return count;
+}
+
+// One label per block, entered once the whole block fits the budget and its code is still the ROM's,
+// blocks jump straight to the blocks after them, everything else goes through the dispatcher
+static void emit_block(FILE* out, uint16_t start, uint32_t image_end, int* handler_index, const quirk_profile_t* quirks) {
+    instruction_t block[BLOCK_MAX_LENGTH];
+    int length = decode_block(start, block);
+    const instruction_t* last = &block[length - 1];
+    uint32_t end = last->address + get_instruction_size(last);
+
+    // The word after the block is compared as well, it decides how far a skip ending the block jumps
+    uint32_t compared_end = end + 2 < image_end ? end + 2 : image_end;
+
+    fprintf(out, "block_%04X:\n", start);
+    fprintf(out, "    if (executed + %d > budget || !is_aot_code_intact(cpu, ROM, 0x%04X, %u)) goto interpret;\n", length, start, compared_end - start);
+    fprintf(out, "    executed += %d;\n", length);
+    for (int i = 0; i < length; i++) {
+        const instruction_t* instruction = &block[i];
+        fprintf(out, "    // 0x%04X: %04X %s\n", instruction->address, instruction->opcode, OP_NAMES[instruction->op]);
+        if (IS_INLINED[instruction->op]) {
+            emit_inline(out, instruction, quirks);
+            continue;
+        }
+
+        // Handlers expect the program counter past the instruction, the waiting ones step it back onto themselves
+        // and skips move it on
+        bool is_wait = instruction->op == OP_FX0A || (instruction->op == OP_DXYN && quirks->is_display_wait);
+        if (is_wait || is_skip(instruction->op)) {
+            fprintf(out, "    cpu->pc = 0x%04X;\n", (instruction->address + 2) & (MEMORY_SIZE - 1));
+        }
+        fprintf(out, "    handlers[OP_%s](cpu, &INSTRUCTIONS[%d]);\n", OP_NAMES[instruction->op], (*handler_index)++);
+        if (is_wait) {
+            fprintf(out, "    if (cpu->wait_state) return executed;\n");
+        }
+    }
+    emit_block_end(out, last, quirks);
+}
+
+static void emit_engine(FILE* out, const options_t* options, uint32_t image_size) {
+    const quirk_profile_t* quirks = &QUIRK_PROFILES[options->quirks];
+
+    fprintf(out, "// Generated by chip8-aot from %s with the %s quirks, do not edit\n\n", options->rom, quirks->name);
+    fprintf(out, "#include \"aot.h\"\n");
+    fprintf(out, "#include \"chip8.h\"\n");
+    fprintf(out, "#include \"instructions.h\"\n\n");
+
+    // The ROM as loaded, followed by the word after it
+    fprintf(out, "static const uint8_t ROM[%u] = {", image_size);
+    for (uint32_t i = 0; i < image_size; i++) {
+        fprintf(out, "%s0x%02X,", i % ROM_BYTES_PER_LINE ? " " : "\n    ", cpu.memory[PC_START_ADDR + i]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    int handler_count = emit_instructions(out);
+
+    fprintf(out, "static int run(chip8_t* cpu, int budget) {\n");
+    if (handler_count > 0) {
+        fprintf(out, "    const OpFuncPtr* handlers = QUIRK_HANDLERS[%s];\n", QUIRK_IDS[options->quirks]);
+    }
+    fprintf(out, "    int executed = 0;\n\n");
+
+    // Addresses the ROM reaches without a block of its own, through BNNN, returns and code it wrote, are interpreted
+    fprintf(out, "dispatch:\n");
+    fprintf(out, "    switch (cpu->pc) {\n");
+    for (uint32_t address = PC_START_ADDR; address < rom_end; address++) {
+        if (is_block_start[address]) {
+            fprintf(out, "        case 0x%04X:\n", address);
+            fprintf(out, "            goto block_%04X;\n", address);
+        }
+    }
+    fprintf(out, "    }\n");
+    fprintf(out, "interpret:\n");
+    fprintf(out, "    if (executed >= budget) return executed;\n");
+    fprintf(out, "    step_chip8(cpu);\n");
+    fprintf(out, "    executed++;\n");
+    fprintf(out, "    if (cpu->wait_state) return executed;\n");
+    fprintf(out, "    goto dispatch;\n");
+
+    int handler_index = 0;
+    for (uint32_t address = PC_START_ADDR; address < rom_end; address++) {
+        if (is_block_start[address]) {
+            fprintf(out, "\n");
+            emit_block(out, address, PC_START_ADDR + image_size, &handler_index, quirks);
+        }
+    }
+    fprintf(out, "}\n\n");
+
+    fprintf(out, "const aot_t %s = {\n", options->name);
+    fprintf(out, "    .rom = ROM,\n");
+    fprintf(out, "    .size = sizeof(ROM),\n");
+    fprintf(out, "    .quirks = %s,\n", QUIRK_IDS[options->quirks]);
+    fprintf(out, "    .run = run,\n");
+    fprintf(out, "};\n");
+}
+
+int main(int argc, char* argv[]) {
+    options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    init_chip8(&cpu);
+    if (!load_rom(&cpu, options.rom)) {
+        printf("Failed to read ROM: %s\n", options.rom);
+        return EXIT_FAILURE;
+    }
+    set_chip8_quirks(&cpu, options.quirks);
+
+    // As much as `load_rom` read, the last word of memory is left to the interpreter, its next word wraps around
+    FILE* file = fopen(options.rom, "rb");
+    if (!file) {
+        printf("Failed to read ROM: %s\n", options.rom);
+        return EXIT_FAILURE;
+    }
+    fseek(file, 0, SEEK_END);
+    long rom_size = ftell(file);
+    fclose(file);
+    if (rom_size > MEMORY_SIZE - PC_START_ADDR) {
+        rom_size = MEMORY_SIZE - PC_START_ADDR;
+    }
+    rom_end = PC_START_ADDR + rom_size < MEMORY_SIZE - 2 ? PC_START_ADDR + rom_size : MEMORY_SIZE - 2;
+    uint32_t image_size = rom_size + 2 < MEMORY_SIZE - PC_START_ADDR ? rom_size + 2 : MEMORY_SIZE - PC_START_ADDR;
+
+    find_blocks();
+
+    int blocks = 0;
+    int instructions = 0;
+    for (uint32_t address = PC_START_ADDR; address < rom_end; address++) {
+        if (is_block_start[address]) {
+            instruction_t block[BLOCK_MAX_LENGTH];
+            blocks++;
+            instructions += decode_block(address, block);
+        }
+    }
+    if (blocks == 0) {
+        printf("No code found in ROM: %s\n", options.rom);
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = fopen(options.output, "w");
+    if (!out) {
+        printf("Failed to write: %s\n", options.output);
+        return EXIT_FAILURE;
+    }
+    emit_engine(out, &options, image_size);
+    bool is_ok = !ferror(out);
+    is_ok &= fclose(out) == 0;
+    if (!is_ok) {
+        printf("Failed to write: %s\n", options.output);
+        return EXIT_FAILURE;
+    }
+
+    printf("quirks: %s\n", QUIRK_PROFILES[options.quirks].name);
+    printf("blocks: %d\n", blocks);
+    printf("instructions: %d\n", instructions);
+    return EXIT_SUCCESS;
+}
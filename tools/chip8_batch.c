@@ -0,0 +1,196 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "lockstep.h"
+#include "quirks.h"
+
+#define DEFAULT_INSTANCES 1024
+#define DEFAULT_FRAMES 60
+#define DEFAULT_INSTRUCTIONS_PER_FRAME 13
+#define MAX_THREAD_COUNTS 32
+
+typedef struct {
+    const char* rom;
+    int instances;
+    int frames;
+    int instructions_per_frame;
+    backend_t backend;
+    int thread_counts[MAX_THREAD_COUNTS];  // Runs the benchmark once per entry
+    int thread_count_count;
+    bool is_lockstep;
+    uint64_t seed;  // CXNN seed of the first instance, the others count up from it
+    quirks_t quirks;
+} options_t;
+
+static void print_usage(const char* name) {
+    printf("Usage: %s <ROM> [--instances N] [--frames N] [--ipf N] [--threads N,N,...] [--backend=NAME] [--lockstep] [--seed N] [--quirks=NAME]\n", name);
+    printf("  --instances N     Machines running the ROM (default %d)\n", DEFAULT_INSTANCES);
+    printf("  --frames N        Frames per machine (default %d)\n", DEFAULT_FRAMES);
+    printf("  --ipf N           Instructions per frame (default %d)\n", DEFAULT_INSTRUCTIONS_PER_FRAME);
+    printf("  --threads N,N,... Worker thread counts to compare (default powers of two up to the CPU count)\n");
+    printf("  --backend=NAME    Execution backend, interp, threaded or jit (default interp)\n");
+    printf("  --seed N          CXNN seed of the first instance, instance K gets N+K (default 0)\n");
+    printf("  --quirks=NAME     Quirk profile, vip, chip48, schip or xochip (default vip)\n");
+    printf("  --lockstep        Also run the instances in SIMD lockstep groups of %d on one thread\n", LOCKSTEP_LANES);
+}
+
+static bool parse_thread_counts(const char* list, options_t* options) {
+    while (*list && options->thread_count_count < MAX_THREAD_COUNTS) {
+        char* end;
+        long count = strtol(list, &end, 10);
+        if (end == list || count <= 0) {
+            return false;
+        }
+        options->thread_counts[options->thread_count_count++] = count;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return *list == '\0';
+}
+
+static bool parse_options(int argc, char* argv[], options_t* options) {
+    *options = (options_t){
+        .instances = DEFAULT_INSTANCES,
+        .frames = DEFAULT_FRAMES,
+        .instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--instances") == 0 && has_value) {
+            options->instances = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && has_value) {
+            options->frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ipf") == 0 && has_value) {
+            options->instructions_per_frame = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+            if (!parse_thread_counts(argv[++i], options)) return false;
+        } else if (strncmp(argv[i], "--backend=", 10) == 0) {
+            if (!parse_backend(argv[i] + 10, &options->backend)) return false;
+        } else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+            options->seed = strtoull(argv[++i], NULL, 0);
+        } else if (strncmp(argv[i], "--quirks=", 9) == 0) {
+            if (!parse_quirks(argv[i] + 9, &options->quirks)) return false;
+        } else if (strcmp(argv[i], "--lockstep") == 0) {
+            options->is_lockstep = true;
+        } else if (argv[i][0] != '-' && !options->rom) {
+            options->rom = argv[i];
+        } else {
+            return false;
+        }
+    }
+
+    if (!options->thread_count_count) {
+        long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int count = 1; options->thread_count_count < MAX_THREAD_COUNTS; count *= 2) {
+            options->thread_counts[options->thread_count_count++] = count < cpu_count ? count : cpu_count;
+            if (count >= cpu_count) break;
+        }
+    }
+    return options->rom && options->instances > 0 && options->frames > 0 && options->instructions_per_frame > 0;
+}
+
+static double get_time_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_result(const char* label, uint64_t instructions, double elapsed, double base_speed) {
+    double speed = elapsed > 0 ? instructions / elapsed / 1e6 : 0;
+    printf("%8s %14llu %9.3fs %10.2f %7.2fx\n", label, (unsigned long long)instructions, elapsed, speed,
+           base_speed > 0 ? speed / base_speed : 0);
+}
+
+// Same instances in groups of `LOCKSTEP_LANES`, rounded up
+static bool run_lockstep(const options_t* options, double base_speed) {
+    int group_count = (options->instances + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES;
+    lockstep_t** groups = calloc(group_count, sizeof(lockstep_t*));
+    if (!groups) {
+        return false;
+    }
+
+    bool is_ok = true;
+    for (int i = 0; i < group_count && is_ok; i++) {
+        groups[i] = lockstep_create();
+        is_ok = groups[i] && lockstep_load_rom(groups[i], options->rom);
+        if (is_ok) {
+            lockstep_set_quirks(groups[i], options->quirks);
+        }
+        for (int lane = 0; is_ok && lane < LOCKSTEP_LANES; lane++) {
+            seed_chip8(lockstep_get(groups[i], lane), options->seed + i * LOCKSTEP_LANES + lane);
+        }
+    }
+
+    if (is_ok) {
+        uint64_t instructions = 0;
+        double start = get_time_seconds();
+        for (int i = 0; i < group_count; i++) {
+            for (int frame = 0; frame < options->frames; frame++) {
+                instructions += run_lockstep_frame(groups[i], options->instructions_per_frame);
+            }
+        }
+        print_result("lockstep", instructions, get_time_seconds() - start, base_speed);
+    } else {
+        printf("Failed to run the ROM in lockstep: %s\n", options->rom);
+    }
+
+    for (int i = 0; i < group_count; i++) {
+        lockstep_destroy(groups[i]);
+    }
+    free(groups);
+    return is_ok;
+}
+
+int main(int argc, char* argv[]) {
+    options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%d instances, %d frames, %d instructions per frame\n", options.instances, options.frames, options.instructions_per_frame);
+    printf("%8s %14s %10s %10s %8s\n", "threads", "instructions", "elapsed", "MIPS", "scaling");
+
+    double base_speed = 0;
+    for (int i = 0; i < options.thread_count_count; i++) {
+        batch_t* batch = batch_create(options.instances, options.thread_counts[i], options.backend);
+        if (!batch) {
+            printf("Failed to create %d instances on %d threads\n", options.instances, options.thread_counts[i]);
+            return EXIT_FAILURE;
+        }
+
+        for (int j = 0; j < batch_count(batch); j++) {
+            if (!load_rom(batch_get(batch, j), options.rom)) {
+                printf("Failed to read ROM: %s\n", options.rom);
+                batch_destroy(batch);
+                return EXIT_FAILURE;
+            }
+            seed_chip8(batch_get(batch, j), options.seed + j);
+            set_chip8_quirks(batch_get(batch, j), options.quirks);
+        }
+
+        double start = get_time_seconds();
+        uint64_t instructions = batch_run(batch, options.frames, options.instructions_per_frame);
+        double elapsed = get_time_seconds() - start;
+        batch_destroy(batch);
+
+        if (i == 0) {
+            base_speed = elapsed > 0 ? instructions / elapsed / 1e6 : 0;
+        }
+        char label[16];
+        snprintf(label, sizeof(label), "%d", options.thread_counts[i]);
+        print_result(label, instructions, elapsed, base_speed);
+    }
+
+    if (options.is_lockstep && !run_lockstep(&options, base_speed)) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
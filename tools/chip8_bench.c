@@ -0,0 +1,402 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "instructions.h"
+
+#if defined(CHIP8_BENCH_FRONTEND)
+#include "audio.h"
+#include "video.h"
+#endif
+
+#define DEFAULT_OP_CALLS 2000000
+#define DEFAULT_ROM_INSTRUCTIONS 20000000
+#define DEFAULT_FRONTEND_CALLS 600
+#define DEFAULT_INSTRUCTIONS_PER_FRAME 13
+#define STREAM_LENGTH 256  // Decoded instructions per synthetic stream, cycled through
+
+typedef struct {
+    const char* output;  // JSON file, stdout when not set
+    int op_calls;
+    uint64_t rom_instructions;
+    int frontend_calls;
+    int instructions_per_frame;
+    const char* roms[16];  // Extra ROMs from the command line
+    int rom_count;
+} options_t;
+
+typedef struct {
+    const char* name;
+    const uint8_t* data;
+    size_t size;
+} bundled_rom_t;
+
+// Representative opcode of every op, the bits in `mask` are varied along the stream
+typedef struct {
+    uint16_t opcode;
+    uint16_t mask;
+} op_template_t;
+
+static const op_template_t OP_TEMPLATES[OP_COUNT] = {
+    [OP_ILLEGAL] = {0x0000, 0x0F0F},
+    [OP_00E0] = {0x00E0, 0x0000},
+    [OP_00EE] = {0x00EE, 0x0000},
+    [OP_1NNN] = {0x1200, 0x00FF},
+    [OP_2NNN] = {0x2200, 0x00FF},
+    [OP_3XNN] = {0x3000, 0x0FFF},
+    [OP_4XNN] = {0x4000, 0x0FFF},
+    [OP_5XY0] = {0x5000, 0x0FF0},
+    [OP_6XNN] = {0x6000, 0x0FFF},
+    [OP_7XNN] = {0x7000, 0x0FFF},
+    [OP_8XY0] = {0x8000, 0x0FF0},
+    [OP_8XY1] = {0x8001, 0x0FF0},
+    [OP_8XY2] = {0x8002, 0x0FF0},
+    [OP_8XY3] = {0x8003, 0x0FF0},
+    [OP_8XY4] = {0x8004, 0x0FF0},
+    [OP_8XY5] = {0x8005, 0x0FF0},
+    [OP_8XY6] = {0x8006, 0x0FF0},
+    [OP_8XY7] = {0x8007, 0x0FF0},
+    [OP_8XYE] = {0x800E, 0x0FF0},
+    [OP_9XY0] = {0x9000, 0x0FF0},
+    [OP_ANNN] = {0xA000, 0x0FFF},
+    [OP_BNNN] = {0xB200, 0x00FF},
+    [OP_CXNN] = {0xC000, 0x0FFF},
+    [OP_DXYN] = {0xD005, 0x0FF0},
+    [OP_EX9E] = {0xE09E, 0x0F00},
+    [OP_EXA1] = {0xE0A1, 0x0F00},
+    [OP_FX07] = {0xF007, 0x0F00},
+    [OP_FX0A] = {0xF00A, 0x0F00},
+    [OP_FX15] = {0xF015, 0x0F00},
+    [OP_FX18] = {0xF018, 0x0F00},
+    [OP_FX1E] = {0xF01E, 0x0F00},
+    [OP_FX29] = {0xF029, 0x0F00},
+    [OP_FX33] = {0xF033, 0x0F00},
+    [OP_FX55] = {0xF055, 0x0F00},
+    [OP_FX65] = {0xF065, 0x0F00},
+    [OP_F002] = {0xF002, 0x0000},
+    [OP_FX3A] = {0xF03A, 0x0F00},
+    [OP_00CN] = {0x00C0, 0x000F},
+    [OP_00FB] = {0x00FB, 0x0000},
+    [OP_00FC] = {0x00FC, 0x0000},
+    [OP_00FE] = {0x00FE, 0x0000},
+    [OP_00FF] = {0x00FF, 0x0000},
+    [OP_FX30] = {0xF030, 0x0F00},
+    [OP_FX75] = {0xF075, 0x0F00},
+    [OP_FX85] = {0xF085, 0x0F00},
+    [OP_00DN] = {0x00D0, 0x000F},
+    [OP_F000] = {0xF000, 0x0000},
+    [OP_5XY2] = {0x5002, 0x0FF0},
+    [OP_5XY3] = {0x5003, 0x0FF0},
+    [OP_FN01] = {0xF001, 0x0300},
+};
+
+// clang-format off
+// Register arithmetic in a tight loop
+static const uint8_t ROM_ALU[] = {
+    0x70, 0x01, 0x81, 0x04, 0x82, 0x14, 0x83, 0x25, 0x84, 0x36, 0x85, 0x07,
+    0x86, 0x13, 0x77, 0x03, 0x88, 0x71, 0x89, 0x82, 0x8A, 0x93, 0x6B, 0x05,
+    0x8B, 0xA4, 0x8C, 0xB5, 0x8D, 0xC2, 0x8E, 0x01, 0xA3, 0x00, 0xF0, 0x1E,
+    0x71, 0x01, 0x72, 0x11, 0x12, 0x00,
+};
+
+// Arithmetic, BCD, register dumps, a subroutine, skips and two sprites per iteration
+static const uint8_t ROM_MIXED[] = {
+    0x00, 0xE0, 0x60, 0x00, 0x61, 0x01, 0x62, 0x05, 0x63, 0x00, 0x64, 0x00,
+    0x80, 0x14, 0x81, 0x26, 0x82, 0x17, 0x83, 0x03, 0x84, 0x02, 0x85, 0x11,
+    0x8E, 0x35, 0x8F, 0x14, 0x8A, 0x0E, 0x8B, 0x56, 0x73, 0x07, 0xA2, 0x5C,
+    0xF3, 0x33, 0xF2, 0x65, 0xA2, 0x5C, 0xF2, 0x55, 0xF0, 0x65, 0xF1, 0x1E,
+    0x34, 0x05, 0x12, 0x36, 0x64, 0x00, 0x74, 0x01, 0x22, 0x4E, 0xA2, 0x56,
+    0xD3, 0x45, 0xD1, 0x25, 0x43, 0x00, 0x12, 0x0C, 0x90, 0x10, 0x12, 0x0C,
+    0x50, 0x10, 0x12, 0x0C, 0xB2, 0x0C, 0x88, 0x54, 0x89, 0x67, 0x89, 0xA5,
+    0x00, 0xEE, 0xF0, 0x90, 0xF0, 0x90, 0xF0, 0xAA, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// Waits on the delay timer and polls a key between moving a sprite, like most games
+static const uint8_t ROM_IDLE[] = {
+    0x00, 0xE0, 0xA2, 0x1C, 0xD0, 0x15, 0x6A, 0x08, 0xFA, 0x15, 0xFB, 0x07,
+    0x3B, 0x00, 0x12, 0x0A, 0x70, 0x01, 0x40, 0x40, 0x60, 0x00, 0xE1, 0x9E,
+    0x12, 0x02, 0x12, 0x02, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// Writes the instruction it is about to run, every iteration
+static const uint8_t ROM_SMC[] = {
+    0x66, 0x00, 0x75, 0x01, 0x60, 0x71, 0x81, 0x50, 0xA2, 0x0C, 0xF1, 0x55,
+    0x00, 0x00, 0x86, 0x14, 0xA2, 0x1A, 0xF6, 0x33, 0xA2, 0x1E, 0xD0, 0x16,
+    0x12, 0x02, 0x00, 0x00, 0x00, 0x00, 0x80, 0x40, 0x20, 0x10, 0x08, 0x04,
+};
+
+// Draws at random positions and waits for a key when the timer runs out
+static const uint8_t ROM_RANDOM[] = {
+    0xA2, 0x1E, 0xC0, 0x3F, 0xC1, 0x1F, 0xC2, 0x0F, 0xE2, 0x9E, 0x12, 0x10,
+    0x73, 0x01, 0xF3, 0x15, 0xD0, 0x15, 0xF4, 0x07, 0x34, 0x00, 0x12, 0x02,
+    0xF3, 0x0A, 0x82, 0x34, 0x12, 0x02, 0xF0, 0x90, 0xF0, 0x90, 0xF0,
+};
+
+// Draws 16x16 sprites in hi-res and scrolls the whole display down, right and left after each
+static const uint8_t ROM_SCROLL[] = {
+    0x00, 0xFF, 0xA2, 0x12, 0xC0, 0x7F, 0xC1, 0x3F, 0xD0, 0x10, 0x00, 0xC1,
+    0x00, 0xFB, 0x00, 0xFC, 0x12, 0x04, 0xF0, 0x0F, 0xF0, 0x0F, 0xF0, 0x0F,
+    0xF0, 0x0F, 0xF0, 0x0F, 0xF0, 0x0F, 0xF0, 0x0F, 0xF0, 0x0F, 0x0F, 0xF0,
+    0x0F, 0xF0, 0x0F, 0xF0, 0x0F, 0xF0, 0x0F, 0xF0, 0x0F, 0xF0, 0x0F, 0xF0,
+    0x0F, 0xF0,
+};
+// clang-format on
+
+static const bundled_rom_t BUNDLED_ROMS[] = {
+    {"alu", ROM_ALU, sizeof(ROM_ALU)},
+    {"mixed", ROM_MIXED, sizeof(ROM_MIXED)},
+    {"idle", ROM_IDLE, sizeof(ROM_IDLE)},
+    {"smc", ROM_SMC, sizeof(ROM_SMC)},
+    {"random", ROM_RANDOM, sizeof(ROM_RANDOM)},
+    {"scroll", ROM_SCROLL, sizeof(ROM_SCROLL)},
+};
+
+static const backend_t BACKENDS[] = {BACKEND_INTERP, BACKEND_THREADED, BACKEND_JIT};
+static const char* const BACKEND_NAMES[] = {"interp", "threaded", "jit"};
+
+static void print_usage(const char* name) {
+    printf("Usage: %s [ROM...] [--output FILE] [--op-calls N] [--instructions N] [--frontend-calls N] [--ipf N]\n", name);
+    printf("  ROM...              Extra ROMs to measure next to the bundled ones\n");
+    printf("  --output FILE       Write the JSON results to FILE instead of stdout\n");
+    printf("  --op-calls N        Handler calls per op (default %d)\n", DEFAULT_OP_CALLS);
+    printf("  --instructions N    Instruction slots per ROM and backend, waits included (default %d)\n", DEFAULT_ROM_INSTRUCTIONS);
+    printf("  --frontend-calls N  Calls of video_update and audio_update (default %d)\n", DEFAULT_FRONTEND_CALLS);
+    printf("  --ipf N             Instructions per frame for ROMs (default %d)\n", DEFAULT_INSTRUCTIONS_PER_FRAME);
+}
+
+static bool parse_options(int argc, char* argv[], options_t* options) {
+    *options = (options_t){
+        .op_calls = DEFAULT_OP_CALLS,
+        .rom_instructions = DEFAULT_ROM_INSTRUCTIONS,
+        .frontend_calls = DEFAULT_FRONTEND_CALLS,
+        .instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--output") == 0 && has_value) {
+            options->output = argv[++i];
+        } else if (strcmp(argv[i], "--op-calls") == 0 && has_value) {
+            options->op_calls = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--instructions") == 0 && has_value) {
+            options->rom_instructions = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--frontend-calls") == 0 && has_value) {
+            options->frontend_calls = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ipf") == 0 && has_value) {
+            options->instructions_per_frame = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && options->rom_count < 16) {
+            options->roms[options->rom_count++] = argv[i];
+        } else {
+            return false;
+        }
+    }
+    return options->op_calls > 0 && options->rom_instructions > 0 && options->instructions_per_frame > 0;
+}
+
+// Writes `text` as a JSON string, with quotes, backslashes and control characters escaped
+static void print_json_string(FILE* out, const char* text) {
+    fputc('"', out);
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04X", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static double get_time_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Reset the state a handler may have moved out of range, so every call does the same work
+static void reset_op_state(chip8_t* cpu) {
+    cpu->pc = PC_START_ADDR;
+    cpu->i = 0x300;
+    cpu->is_redraw_needed = false;  // DXYN would only wait for the vblank otherwise
+}
+
+static void bench_ops(FILE* out, const options_t* options) {
+    static chip8_t cpu;
+    init_chip8(&cpu);
+    cpu.keyboard[0x5] = true;  // FX0A finds a held key, as when a press ends the wait
+
+    fprintf(out, "  \"ops\": [\n");
+    for (int op = 0; op < OP_COUNT; op++) {
+        instruction_t stream[STREAM_LENGTH];
+        for (int i = 0; i < STREAM_LENGTH; i++) {
+            // Spread the varying bits over the stream with a cheap hash of the index
+            uint16_t bits = (i * 0x9E37) & OP_TEMPLATES[op].mask;
+            stream[i] = decode_instruction(OP_TEMPLATES[op].opcode | bits, cpu.quirks);
+        }
+
+        // Baseline loop with only the state reset, subtracted from the handler timing
+        double start = get_time_seconds();
+        for (int i = 0; i < options->op_calls; i++) {
+            reset_op_state(&cpu);
+            __asm__ volatile("" ::: "memory");
+        }
+        double overhead = get_time_seconds() - start;
+
+        OpFuncPtr handler = QUIRK_HANDLERS[cpu.quirks][op];
+        start = get_time_seconds();
+        for (int i = 0; i < options->op_calls; i++) {
+            reset_op_state(&cpu);
+            handler(&cpu, &stream[i % STREAM_LENGTH]);
+        }
+        double elapsed = get_time_seconds() - start;
+
+        double ns = (elapsed - overhead) / options->op_calls * 1e9;
+        fprintf(out, "    {\"op\": \"%s\", \"calls\": %d, \"ns_per_call\": %.3f}%s\n", OP_NAMES[op], options->op_calls,
+                ns > 0 ? ns : 0, op + 1 < OP_COUNT ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    cleanup_chip8(&cpu);
+}
+
+// Entries are separated before rather than after, so the array stays valid whichever ROM is the last one written
+static void bench_rom(FILE* out, const options_t* options, const char* name, const uint8_t* data, size_t size, bool is_first) {
+    for (size_t b = 0; b < sizeof(BACKENDS) / sizeof(BACKENDS[0]); b++) {
+        static chip8_t cpu;
+        memset(&cpu, 0, sizeof(cpu));
+        init_chip8(&cpu);
+        memcpy(cpu.memory + PC_START_ADDR, data, size);
+
+        // The run is bounded by slots, a ROM waiting for a key retires nothing but still ends
+        uint64_t slots = 0;
+        uint64_t instructions = 0;
+        uint64_t frames = 0;
+        double start = get_time_seconds();
+        while (slots < options->rom_instructions) {
+            instructions += run_chip8_frame(&cpu, BACKENDS[b], options->instructions_per_frame);
+            slots += options->instructions_per_frame;
+            frames++;
+        }
+        double elapsed = get_time_seconds() - start;
+        cleanup_chip8(&cpu);
+
+        fprintf(out, "%s    {\"rom\": ", is_first && b == 0 ? "" : ",\n");
+        print_json_string(out, name);
+        fprintf(out, ", \"backend\": \"%s\", \"slots\": %llu, \"instructions\": %llu, \"frames\": %llu, \"seconds\": %.6f, \"instructions_per_second\": %.0f}",
+                BACKEND_NAMES[b], (unsigned long long)slots, (unsigned long long)instructions, (unsigned long long)frames, elapsed,
+                elapsed > 0 ? instructions / elapsed : 0);
+    }
+}
+
+// Closes the array on every path, a ROM that can't be read ends it early
+static bool bench_roms(FILE* out, const options_t* options) {
+    int bundled_count = sizeof(BUNDLED_ROMS) / sizeof(BUNDLED_ROMS[0]);
+    bool is_ok = true;
+
+    fprintf(out, "  \"roms\": [\n");
+    for (int i = 0; i < bundled_count; i++) {
+        const bundled_rom_t* rom = &BUNDLED_ROMS[i];
+        bench_rom(out, options, rom->name, rom->data, rom->size, i == 0);
+    }
+
+    for (int i = 0; i < options->rom_count && is_ok; i++) {
+        static uint8_t data[MEMORY_SIZE - PC_START_ADDR];
+        FILE* file = fopen(options->roms[i], "rb");
+        if (!file) {
+            fprintf(stderr, "Failed to read ROM: %s\n", options->roms[i]);
+            is_ok = false;
+            break;
+        }
+        size_t size = fread(data, 1, sizeof(data), file);
+        fclose(file);
+        bench_rom(out, options, options->roms[i], data, size, false);
+    }
+    fprintf(out, "\n  ],\n");
+    return is_ok;
+}
+
+// Writes a null entry if the frontend can't be measured, so the object is always complete
+static bool bench_frontend(FILE* out, const options_t* options) {
+#if defined(CHIP8_BENCH_FRONTEND)
+    if (!video_init() || !audio_init()) {
+        video_cleanup();
+        audio_cleanup();
+        fprintf(out, "  \"frontend\": null\n");
+        return false;
+    }
+
+    frame_t frame = {0};
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        for (int word = 0; word < DISPLAY_WORDS; word++) {
+            frame.display[0][y][word] = 0xAAAAAAAAAAAAAAAAull >> (y & 1);
+        }
+    }
+
+    // Every call uploads and presents a whole frame, as when the ROM redrew every row since the last vblank
+    frame.dirty_rows = DISPLAY_ALL_ROWS;
+    double start = get_time_seconds();
+    for (int i = 0; i < options->frontend_calls; i++) {
+        frame.frame_number = i + 1;
+        if (!video_update(&frame)) {
+            video_cleanup();
+            audio_cleanup();
+            fprintf(out, "  \"frontend\": null\n");
+            return false;
+        }
+    }
+    double video_elapsed = get_time_seconds() - start;
+
+    // Alternate between silence and a tone, so every call hands new sound to the callback
+    static chip8_t cpu;
+    start = get_time_seconds();
+    for (int i = 0; i < options->frontend_calls; i++) {
+        cpu.sound_timer = i & 1;
+        audio_update(&cpu);
+    }
+    double audio_elapsed = get_time_seconds() - start;
+
+    video_cleanup();
+    audio_cleanup();
+
+    fprintf(out, "  \"frontend\": {\"calls\": %d, \"video_update_us\": %.3f, \"audio_update_us\": %.3f}\n", options->frontend_calls,
+            video_elapsed / options->frontend_calls * 1e6, audio_elapsed / options->frontend_calls * 1e6);
+#else
+    fprintf(out, "  \"frontend\": null\n");
+#endif
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = options.output ? fopen(options.output, "w") : stdout;
+    if (!out) {
+        printf("Failed to open output: %s\n", options.output);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"instructions_per_frame\": %d,\n", options.instructions_per_frame);
+    bench_ops(out, &options);
+    bool is_ok = bench_roms(out, &options);
+    if (is_ok) {
+        is_ok = bench_frontend(out, &options);
+    } else {
+        fprintf(out, "  \"frontend\": null\n");
+    }
+    fprintf(out, "}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
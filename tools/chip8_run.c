@@ -0,0 +1,300 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aot.h"
+#include "chip8.h"
+#include "movie.h"
+#include "profile.h"
+#include "quirks.h"
+#include "state.h"
+
+#define DEFAULT_CPU_HZ 800
+#define DEFAULT_FPS 60
+#define DEFAULT_INSTRUCTIONS_PER_FRAME (DEFAULT_CPU_HZ / DEFAULT_FPS)
+#define DEFAULT_FRAMES 600
+
+// Engine generated by chip8-aot for the ROM built into chip8-run-aot
+#if defined(CHIP8_AOT_ENGINE)
+extern const aot_t CHIP8_AOT_ENGINE;
+#endif
+
+typedef struct {
+    const char* rom;
+    uint64_t instructions;  // Stop after this many instructions, 0 to run by frames only
+    uint64_t frames;        // Stop after this many frames, 0 to run by instructions only
+    int instructions_per_frame;
+    backend_t backend;
+    bool is_compare;
+    bool is_dump;
+    const char* load_state;  // State file to start from, after loading the ROM
+    const char* save_state;  // State file to write when done
+    const char* replay;      // Movie to replay instead of running by frames
+    bool is_profile;
+    uint64_t seed;  // CXNN seed
+    quirks_t quirks;
+    bool is_quirks_set;      // `quirks` given on the command line, the database isn't looked at
+    const char* quirks_db;  // ROM hash to quirk profile database
+} options_t;
+
+static void print_usage(const char* name) {
+    printf("Usage: %s <ROM> [--instructions N] [--frames N] [--ipf N] [--backend=NAME] [--compare] [--dump] [--load-state FILE] [--save-state FILE] [--replay FILE] [--profile] [--seed N] [--quirks=NAME] [--quirks-db=FILE]\n", name);
+    printf("  --instructions N  Stop after N instruction slots, waits included\n");
+    printf("  --frames N        Stop after N frames (default %d)\n", DEFAULT_FRAMES);
+    printf("  --ipf N           Instructions per frame (default %d)\n", DEFAULT_INSTRUCTIONS_PER_FRAME);
+    printf("  --backend=NAME    Execution backend, interp, threaded, jit or aot (default interp)\n");
+    printf("  --compare         Check the state against the interpreter after every frame\n");
+    printf("  --dump            Print the final display\n");
+    printf("  --load-state FILE Start from a saved state\n");
+    printf("  --save-state FILE Save the final state\n");
+    printf("  --replay FILE     Replay a recorded movie uncapped and check the final state\n");
+    printf("  --profile         Count executions per op and address, runs in the interpreter\n");
+    printf("  --seed N          Seed for CXNN (default 0)\n");
+    printf("  --quirks=NAME     Quirk profile, vip, chip48, schip or xochip (default vip)\n");
+    printf("  --quirks-db=FILE  Pick the quirk profile by ROM hash from FILE, lines of <hash> <profile>\n");
+}
+
+static bool parse_options(int argc, char* argv[], options_t* options) {
+    *options = (options_t){
+        .instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--instructions") == 0 && has_value) {
+            options->instructions = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--frames") == 0 && has_value) {
+            options->frames = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--ipf") == 0 && has_value) {
+            options->instructions_per_frame = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "--backend=", 10) == 0) {
+            if (!parse_backend(argv[i] + 10, &options->backend)) return false;
+        } else if (strcmp(argv[i], "--compare") == 0) {
+            options->is_compare = true;
+        } else if (strcmp(argv[i], "--load-state") == 0 && has_value) {
+            options->load_state = argv[++i];
+        } else if (strcmp(argv[i], "--save-state") == 0 && has_value) {
+            options->save_state = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && has_value) {
+            options->replay = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+            options->seed = strtoull(argv[++i], NULL, 0);
+        } else if (strncmp(argv[i], "--quirks=", 9) == 0) {
+            if (!parse_quirks(argv[i] + 9, &options->quirks)) return false;
+            options->is_quirks_set = true;
+        } else if (strncmp(argv[i], "--quirks-db=", 12) == 0 && argv[i][12]) {
+            options->quirks_db = argv[i] + 12;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            options->is_profile = true;
+        } else if (strcmp(argv[i], "--dump") == 0) {
+            options->is_dump = true;
+        } else if (argv[i][0] != '-' && !options->rom) {
+            options->rom = argv[i];
+        } else {
+            return false;
+        }
+    }
+
+    if (!options->instructions && !options->frames) {
+        options->frames = DEFAULT_FRAMES;
+    }
+    // Movies start from power on and carry their own timing and seed
+    if (options->replay && (options->load_state || options->is_compare)) {
+        return false;
+    }
+    return options->rom && options->instructions_per_frame > 0;
+}
+
+static double get_time_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// FNV-1a, used to compare runs across builds, backends and machines
+static uint32_t hash_bytes(uint32_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Only the pixels of the current mode, lo-res rows are the first word of the top rows, and the second
+// plane only once it holds pixels, so displays that never use it hash as a single plane
+static uint32_t hash_display(const chip8_t* cpu) {
+    uint32_t hash = 2166136261u;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        uint64_t pixels = 0;
+        for (int y = 0; y < get_display_height(cpu); y++) {
+            for (int word = 0; word < DISPLAY_WORDS; word++) {
+                pixels |= cpu->display[plane][y][word];
+            }
+        }
+        if (plane && !pixels) {
+            continue;
+        }
+        for (int y = 0; y < get_display_height(cpu); y++) {
+            hash = hash_bytes(hash, cpu->display[plane][y], get_display_width(cpu) / 8);
+        }
+    }
+    return hash;
+}
+
+static uint32_t hash_state(const chip8_t* cpu) {
+    uint32_t hash = hash_display(cpu);
+    hash = hash_bytes(hash, cpu->memory, sizeof(cpu->memory));
+    hash = hash_bytes(hash, &cpu->pc, sizeof(cpu->pc));
+    hash = hash_bytes(hash, cpu->stack, sizeof(cpu->stack));
+    hash = hash_bytes(hash, &cpu->sp, sizeof(cpu->sp));
+    hash = hash_bytes(hash, cpu->v, sizeof(cpu->v));
+    hash = hash_bytes(hash, &cpu->i, sizeof(cpu->i));
+    hash = hash_bytes(hash, &cpu->delay_timer, sizeof(cpu->delay_timer));
+    hash = hash_bytes(hash, &cpu->sound_timer, sizeof(cpu->sound_timer));
+    hash = hash_bytes(hash, &cpu->is_hires, sizeof(cpu->is_hires));
+    hash = hash_bytes(hash, &cpu->planes, sizeof(cpu->planes));
+    return hash;
+}
+
+static void dump_display(const chip8_t* cpu) {
+    for (int y = 0; y < get_display_height(cpu); y++) {
+        for (int x = 0; x < get_display_width(cpu); x++) {
+            putchar(".#+@"[get_display_pixel(cpu, x, y)]);
+        }
+        putchar('\n');
+    }
+}
+
+int main(int argc, char* argv[]) {
+    options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Initialize CPU, and the interpreter running alongside it in compare mode
+    static chip8_t chip8;
+    static chip8_t reference;
+    init_chip8(&chip8);
+    init_chip8(&reference);
+    seed_chip8(&chip8, options.seed);
+    seed_chip8(&reference, options.seed);
+
+    // Try loading the ROM
+    if (!load_rom(&chip8, options.rom) || (options.is_compare && !load_rom(&reference, options.rom))) {
+        printf("Failed to read ROM: %s\n", options.rom);
+        return EXIT_FAILURE;
+    }
+    // A profile given on the command line wins over the database, VIP otherwise
+    if (!options.is_quirks_set && options.quirks_db) {
+        find_rom_quirks(options.quirks_db, options.rom, &options.quirks);
+    }
+    set_chip8_quirks(&chip8, options.quirks);
+    set_chip8_quirks(&reference, options.quirks);
+
+    if (options.load_state && (!load_chip8_state_file(&chip8, options.load_state) ||
+                               (options.is_compare && !load_chip8_state_file(&reference, options.load_state)))) {
+        printf("Failed to load state: %s\n", options.load_state);
+        return EXIT_FAILURE;
+    }
+
+#if defined(CHIP8_AOT_ENGINE)
+    // Code that differs from the compiled ROM runs in the interpreter
+    set_chip8_aot(&chip8, &CHIP8_AOT_ENGINE);
+#endif
+
+    if (options.is_profile && !(chip8.profile = profile_create())) {
+        printf("Failed to allocate the profiler\n");
+        return EXIT_FAILURE;
+    }
+
+    movie_t movie = {0};
+    if (options.replay && !load_movie(&movie, options.replay)) {
+        // Older movies hash a smaller memory and display, they can't be replayed
+        uint32_t version = read_movie_version(options.replay);
+        if (version && version != MOVIE_FILE_VERSION) {
+            printf("Unsupported movie version %u, expected %u: %s\n", version, MOVIE_FILE_VERSION, options.replay);
+        } else {
+            printf("Failed to read movie: %s\n", options.replay);
+        }
+        return EXIT_FAILURE;
+    }
+
+    uint64_t slots = 0;         // Instruction slots, waits and skipped polling loops included
+    uint64_t instructions = 0;  // Instructions actually retired
+    uint64_t frames = 0;
+    bool is_replay_ok = true;
+    double start_time = get_time_seconds();
+
+    if (options.replay) {
+        is_replay_ok = replay_movie(&chip8, &movie, options.backend);
+        slots = chip8.instruction_count;
+        for (size_t i = 0; i < movie.count; i++) {
+            frames += movie.events[i].type == MOVIE_VBLANK;
+        }
+        cleanup_movie(&movie);
+    }
+
+    // Run uncapped
+    while (!options.replay && (!options.frames || frames < options.frames) && (!options.instructions || slots < options.instructions)) {
+        uint64_t budget = options.instructions_per_frame;
+        if (options.instructions && options.instructions - slots < budget) {
+            budget = options.instructions - slots;
+        }
+        instructions += run_chip8_frame(&chip8, options.backend, budget);
+        slots += budget;
+        frames++;
+
+        if (options.is_compare) {
+            run_chip8_frame(&reference, BACKEND_INTERP, budget);
+            if (!is_chip8_state_equal(&chip8, &reference)) {
+                printf("compare: mismatch after frame %llu, instruction %llu\n", (unsigned long long)frames, (unsigned long long)slots);
+                printf("pc: 0x%04X, interpreter pc: 0x%04X\n", chip8.pc, reference.pc);
+                cleanup_chip8(&chip8);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    double elapsed = get_time_seconds() - start_time;
+
+    if (options.is_dump) {
+        dump_display(&chip8);
+    }
+    printf("slots: %llu\n", (unsigned long long)slots);
+    printf("frames: %llu\n", (unsigned long long)frames);
+    printf("elapsed: %.6f s\n", elapsed);
+    if (!options.replay) {
+        // A replay only tracks the slots, the time base of the movie
+        printf("instructions: %llu\n", (unsigned long long)instructions);
+        printf("speed: %.2f MIPS\n", elapsed > 0 ? instructions / elapsed / 1e6 : 0.0);
+    }
+    printf("quirks: %s\n", QUIRK_PROFILES[chip8.quirks].name);
+    printf("pc: 0x%04X\n", chip8.pc);
+    printf("display hash: 0x%08X\n", hash_display(&chip8));
+    printf("state hash: 0x%08X\n", hash_state(&chip8));
+    if (chip8.is_illegal) {
+        printf("illegal opcode: 0x%04X\n", chip8.illegal_opcode);
+    }
+    if (options.is_compare) {
+        printf("compare: ok\n");
+    }
+    if (options.replay) {
+        printf("replay: %s\n", is_replay_ok ? "ok" : "mismatch");
+    }
+    if (chip8.profile) {
+        print_profile(chip8.profile, &chip8, stdout);
+    }
+    if (options.save_state && !save_chip8_state_file(&chip8, options.save_state)) {
+        printf("Failed to save state: %s\n", options.save_state);
+        cleanup_chip8(&chip8);
+        return EXIT_FAILURE;
+    }
+
+    cleanup_chip8(&chip8);
+
+    return is_replay_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}